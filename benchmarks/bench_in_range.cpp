@@ -0,0 +1,88 @@
+// Range test kernels against cv::inRange on HSV frames of the line camera
+// resolutions. One box is the shipped dough range; two boxes are what
+// cv::inRange needs two calls and a bitwise_or for.
+#include "simd_kernels.h"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+using namespace country_style;
+
+namespace {
+
+const int kRepeats = 50;
+
+// Median time of kRepeats runs, in milliseconds
+double timeMs(const std::function<void()>& run) {
+    std::vector<double> times;
+    run();  // Warm the caches and the kernel table
+    for (int i = 0; i < kRepeats; i++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        run();
+        auto end = std::chrono::high_resolution_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    std::nth_element(times.begin(), times.begin() + kRepeats / 2, times.end());
+    return times[kRepeats / 2];
+}
+
+// Kernel levels this build contains and this CPU runs
+std::vector<const SimdKernels*> availableKernels() {
+    const SimdLevel cpu = detectSimdLevel();
+    std::vector<const SimdKernels*> levels = {scalarKernels()};
+    if (cpu >= SimdLevel::Sse41 && sse41Kernels()) levels.push_back(sse41Kernels());
+    if (cpu >= SimdLevel::Avx2 && avx2Kernels()) levels.push_back(avx2Kernels());
+    if (cpu >= SimdLevel::Avx512bw && avx512Kernels()) levels.push_back(avx512Kernels());
+    return levels;
+}
+
+void benchmark(const cv::Size& size, const std::vector<ColorBox>& boxes) {
+    // Random HSV pixels with hue limited to OpenCV's 0..179
+    cv::Mat hsv(size, CV_8UC3);
+    cv::randu(hsv, cv::Scalar(0, 0, 0), cv::Scalar(180, 256, 256));
+    
+    cv::Mat expected, part;
+    auto reference = [&] {
+        for (size_t b = 0; b < boxes.size(); b++) {
+            const ColorBox& box = boxes[b];
+            cv::inRange(hsv, cv::Scalar(box.lower[0], box.lower[1], box.lower[2]),
+                        cv::Scalar(box.upper[0], box.upper[1], box.upper[2]),
+                        b == 0 ? expected : part);
+            if (b > 0) cv::bitwise_or(expected, part, expected);
+        }
+    };
+    const double reference_ms = timeMs(reference);
+    std::printf("%4dx%-4d %d box(es)  cv::inRange %7.3f ms\n", size.width, size.height,
+                static_cast<int>(boxes.size()), reference_ms);
+    
+    cv::Mat mask(size, CV_8UC1);
+    const int pixels = size.width * size.height;
+    for (const SimdKernels* kernels : availableKernels()) {
+        auto run = [&] {
+            kernels->in_range(hsv.ptr<uint8_t>(), mask.ptr<uint8_t>(), pixels,
+                              boxes.data(), static_cast<int>(boxes.size()));
+        };
+        const double ms = timeMs(run);
+        const bool same = cv::countNonZero(mask != expected) == 0;
+        std::printf("%24s %-9s %7.3f ms  %5.2fx%s\n", "", simdLevelName(kernels->level), ms,
+                    reference_ms / ms, same ? "" : "  MISMATCH");
+    }
+}
+
+} // namespace
+
+int main() {
+    const std::vector<cv::Size> sizes = {{640, 480}, {1920, 1080}, {3840, 2160}};
+    const ColorBox dough = {{20, 50, 50}, {40, 255, 255}};
+    const ColorBox dark_crust = {{5, 80, 30}, {20, 255, 160}};
+    
+    std::printf("Selected kernels: %s\n", simdLevelName(simdKernels().level));
+    for (const cv::Size& size : sizes) {
+        benchmark(size, {dough});
+        benchmark(size, {dough, dark_crust});
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+#ifndef BELT_STITCHER_H
+#define BELT_STITCHER_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "rle_mask.h"
+#include "blob_labeler.h"
+
+namespace country_style {
+
+// Line-scan style accounting for a belt moving pieces straight up or down
+// the frame.
+//
+// Each frame the belt displacement is measured by 1D phase correlation of
+// the row profile of the inspected area (column-subsampled byte sums) with
+// the previous frame's, to a fraction of a row. Only the rows the belt
+// brought in since the last frame are segmented; they are appended to a
+// rolling mask of the belt, so every belt row is segmented once however
+// many frames it stays in view. A piece is taken out of the mosaic, whole,
+// as soon as the newest row no longer reaches it, and is measured that one
+// time. Work per frame follows the belt speed instead of the frame rate.
+class BeltStitcher {
+public:
+    BeltStitcher();
+    
+    // +1: the belt moves pieces down the frame, so new rows enter at the
+    // top of the area; -1: up, new rows enter at the bottom
+    void setDirection(int direction);
+    int getDirection() const { return direction_; }
+    
+    // Forget the mosaic and the displacement history; the next frame starts
+    // over with its whole area
+    void reset();
+    
+    // Rows the belt moved in since the last frame, fractions carried over;
+    // the whole area on the first frame or after the area changed
+    int advance(const cv::Mat& frame, const cv::Rect& area);
+    double getLastShift() const { return last_shift_; }
+    
+    // Append the rows newest rows of strip, a mask segmented in frame
+    // coordinates whose edge on the incoming side is the area's edge
+    void append(const RleMask& strip, int rows);
+    
+    // Move the pieces that no longer reach the newest row into pieces, in
+    // the current frame's coordinates (rows of pieces that have already
+    // left the frame lie outside it). Pieces cut off by the start of the
+    // mosaic, or still unfinished when it grows past its limit, are dropped;
+    // returns how many, counting each piece once.
+    int takeComplete(const cv::Rect& area, RleMask& pieces);
+
+private:
+    int direction_;
+    bool started_;
+    cv::Rect area_;
+    double carry_;       // Fraction of a row moved but not yet exposed
+    double last_shift_;  // Rows per frame, used when the profile is too flat
+    cv::Mat profile_;
+    cv::Mat previous_profile_;
+    cv::Mat window_;
+    
+    // Rows of the belt still holding unfinished pieces, oldest first; row
+    // runs are relative to area_.x
+    RleMask mosaic_;
+    bool head_cut_;  // Mosaic starts at the first row ever seen, or where a
+                     // piece was cut off
+    bool head_counted_;  // The piece cut off there was already counted as dropped
+    BlobLabeler labeler_;
+    std::vector<uint8_t> complete_;
+    RleMask pending_;
+    
+    void rowProfile(const cv::Mat& frame, const cv::Rect& area);
+};
+
+} // namespace country_style
+
+#endif // BELT_STITCHER_H
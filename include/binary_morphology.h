@@ -0,0 +1,85 @@
+#ifndef BINARY_MORPHOLOGY_H
+#define BINARY_MORPHOLOGY_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <cstdint>
+#include "rle_mask.h"
+
+namespace country_style {
+
+// Erosion and dilation of binary (0/255) masks held as 1 bit per pixel.
+//
+// The structuring element is split into bands: a run of columns [lo, hi]
+// shared by a contiguous range of kernel rows. Each band is applied along
+// the rows with word-wide shifts (log-step doubling of the run) and then
+// down the columns with AND/OR over whole 64-pixel words, using van
+// Herk/Gil-Werman prefix/suffix blocks when the band is tall. Every pass
+// pads with the same constant border as cv::erode/cv::dilate, so results
+// match cv::morphologyEx bit for bit.
+class BinaryMorphology {
+public:
+    BinaryMorphology();
+    
+    // Use this structuring element, anchored at its center. Returns false
+    // when it cannot be decomposed (a row with several runs, rows that do
+    // not nest, more than 63 pixels across, or a full rectangle, which
+    // OpenCV merges across iterations); callers then use cv::morphologyEx.
+    bool setKernel(const cv::Mat& kernel);
+    
+    // Rows above or below a pixel that one pass can read (0 when unset)
+    int reachRows() const { return reach_rows_; }
+    
+    // cv::morphologyEx(MORPH_OPEN, open_iterations) followed by
+    // cv::morphologyEx(MORPH_CLOSE, close_iterations), in place. mask is a
+    // CV_8UC1 0/255 mask and may be an ROI view (cleaned as a standalone
+    // image); any non-zero byte counts as set.
+    void openClose(cv::Mat& mask, int open_iterations, int close_iterations);
+
+    // Same on a run mask (cleaned as a standalone image of its bounds):
+    // runs are packed straight to bits and read back from them
+    void openClose(RleMask& mask, int open_iterations, int close_iterations);
+
+private:
+    // Kernel columns [lo, hi] applied to kernel rows [top, bottom], all
+    // relative to the anchor
+    struct Band {
+        int lo, hi;
+        int top, bottom;
+    };
+    std::vector<Band> bands_;
+    bool identity_;
+    int reach_rows_;
+    
+    // Packed mask: each row has one guard word on either side
+    int width_;
+    int height_;
+    int words_;   // Data words per row
+    int stride_;  // words_ + 2
+    uint64_t tail_;  // Bits of the last data word that lie past the width
+    std::vector<uint64_t> src_;
+    std::vector<uint64_t> dst_;
+    
+    // Scratch for one band
+    std::vector<uint64_t> run_rows_;    // Horizontal result, height_ x words_
+    std::vector<uint64_t> run_buffer_;  // Doubling scratch for one row
+    std::vector<uint64_t> prefix_;      // van Herk blocks
+    std::vector<uint64_t> suffix_;
+    std::vector<uint64_t> fill_row_;
+    
+    void resize(int width, int height);
+    void pack(const cv::Mat& mask);
+    void unpack(cv::Mat& mask) const;
+    void packRuns(const RleMask& mask);
+    void unpackRuns(RleMask& mask) const;
+    void runPasses(int open_iterations, int close_iterations);
+    // One erosion (Erode) or dilation from src_ into dst_, then swap
+    template <bool Erode> void pass();
+    template <bool Erode> void applyRun(const uint64_t* row, uint64_t* out, int lo, int hi);
+    template <bool Erode> void applyColumn(const Band& band, const uint64_t* rows,
+                                           int row_stride, bool first);
+};
+
+} // namespace country_style
+
+#endif // BINARY_MORPHOLOGY_H
@@ -0,0 +1,85 @@
+#ifndef BLOB_LABELER_H
+#define BLOB_LABELER_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <cstdint>
+#include "rle_mask.h"
+#include "contour_arena.h"
+
+namespace country_style {
+
+// Measurements of one 8-connected foreground blob
+struct BlobStats {
+    int area;              // Pixel count
+    cv::Rect bbox;         // Same as cv::boundingRect of its contour
+    cv::Point2f centroid;  // Mean pixel position
+    double perimeter;      // cv::arcLength of its outer contour; holes add
+                           // their own boundary length
+};
+
+// Run-based connected-component labeling that measures every blob in one
+// pass over the mask, without tracing contours.
+//
+// Each row is split into runs of set pixels; runs touching a run of the
+// previous row (diagonals included) are joined with union-find while area,
+// bounds, coordinate sums and perimeter accumulate on the root. The
+// perimeter follows the outer contour through pixel centers row by row:
+// horizontal edges at tops and bottoms, 1 or sqrt(2) plus horizontal steps
+// between the ends of touching runs, and the concave gaps where runs merge
+// or split. For blobs without holes it equals cv::arcLength of the traced
+// contour.
+class BlobLabeler {
+public:
+    BlobLabeler();
+    
+    // Label the runs of a run mask. Stats are in the frame coordinates of
+    // its bounds; blobs are ordered by their first pixel in raster order.
+    const std::vector<BlobStats>& label(const RleMask& mask);
+    const std::vector<BlobStats>& blobs() const { return blobs_; }
+    
+    // Blob of run i of the mask given to the last label()
+    int runBlob(size_t run) const { return blob_of_label_[run_labels_[run]]; }
+    
+    // Outer contour of a blob from the last label() call, as
+    // cv::findContours(RETR_EXTERNAL, CHAIN_APPROX_SIMPLE) returns it: same
+    // border following, start point and direction, but without its
+    // allocations. Appended to arena as one contour (empty if blob is
+    // invalid).
+    void traceContour(int blob, ContourArena& arena);
+
+private:
+    // Row runs [x0, x1) and their provisional labels
+    std::vector<cv::Vec2i> runs_;
+    std::vector<int> run_labels_;
+    std::vector<int> row_offsets_;
+    
+    // Per provisional label, accumulated on the root
+    std::vector<int> parent_;
+    std::vector<int> area_;
+    std::vector<int64_t> sum_x_;
+    std::vector<int64_t> sum_y_;
+    std::vector<cv::Vec4i> bounds_;  // min x, min y, max x, max y
+    std::vector<double> perimeter_;
+    std::vector<int> blob_of_label_;
+    
+    std::vector<BlobStats> blobs_;
+    cv::Point offset_;
+    cv::Mat trace_buffer_;  // Grows only; each blob is drawn into a view of it
+    
+    // Draw blob with a one pixel border into a view of trace_buffer_
+    cv::Mat drawBlob(int blob);
+    
+    void clear(const cv::Point& offset);
+    void joinRow(int y, size_t prev_begin, size_t prev_end);
+    void finish(size_t prev_begin, size_t prev_end);
+    int newLabel(const cv::Vec2i& run, int y);
+    int findRoot(int label);
+    int merge(int a, int b);  // Returns the surviving root
+    void addRun(int root, const cv::Vec2i& run, int y);
+    void addPerimeter(size_t prev_begin, size_t prev_end, size_t row_begin, size_t row_end);
+};
+
+} // namespace country_style
+
+#endif // BLOB_LABELER_H
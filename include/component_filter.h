@@ -0,0 +1,73 @@
+#ifndef COMPONENT_FILTER_H
+#define COMPONENT_FILTER_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <cstdint>
+#include "rle_mask.h"
+
+namespace country_style {
+
+// Mask cleaning without morphology: drops small specks and fills small
+// pinholes while leaving piece outlines untouched.
+//
+// One raster pass splits every row into alternating runs and labels them
+// with union-find: foreground 8-connected (as cv::findContours traces it),
+// background 4-connected. Each component remembers the component that
+// surrounds it, so the verdicts nest: a hole is filled only if its piece is
+// kept, and a speck inside a filled hole is filled with it. A final pass
+// rewrites only the runs whose value changes.
+class ComponentFilter {
+public:
+    ComponentFilter();
+    
+    // Foreground components with fewer than min_component_area pixels are
+    // cleared; enclosed background holes with at most max_hole_area pixels
+    // are filled. Zero disables either step.
+    void setLimits(int min_component_area, int max_hole_area);
+    int getMinComponentArea() const { return min_component_area_; }
+    int getMaxHoleArea() const { return max_hole_area_; }
+    
+    // Filter a CV_8UC1 0/255 mask in place. An ROI view is filtered as a
+    // standalone image: background touching its edges is never a hole.
+    void apply(cv::Mat& mask);
+
+    // Same on a run mask; background touching its bounds is never a hole
+    void apply(RleMask& mask);
+
+private:
+    int min_component_area_;
+    int max_hole_area_;
+    
+    // Alternating background/foreground row runs [x0, x1) with their
+    // provisional labels
+    struct Run {
+        int x0, x1;
+        int label;
+        bool foreground;
+    };
+    std::vector<Run> runs_;
+    std::vector<int> row_offsets_;
+    std::vector<cv::Vec2i> row_runs_;  // Set runs of the row being labelled
+    
+    // Per provisional label; parents always have smaller labels
+    std::vector<int> parent_;
+    std::vector<int> area_;
+    std::vector<int> outer_;      // Surrounding component, -1 at the border
+    std::vector<uint8_t> foreground_;
+    std::vector<uint8_t> border_;  // Touches the mask edge
+    std::vector<uint8_t> set_;     // Resolved output value
+    
+    int newLabel(const Run& run, bool foreground, int outer, bool border);
+    int findRoot(int label);
+    int merge(int a, int b);  // Returns the surviving root
+    
+    // Label every row (set runs of row y come from row_runs(y, out)) and
+    // resolve each component's output value into set_
+    template <typename RowRuns>
+    bool labelComponents(int width, int height, RowRuns row_runs);
+};
+
+} // namespace country_style
+
+#endif // COMPONENT_FILTER_H
@@ -30,6 +30,20 @@ struct VisionConfig {
     // Processing settings
     int morph_kernel_size;
     bool enable_preprocessing;
+    bool use_color_lut;  // Direct BGR -> mask table instead of HSV threshold
+    bool crop_to_roi;    // Segment and label only the ROI instead of the full frame
+    bool use_component_filter;  // Clean masks by component area instead of morphology
+    int min_component_area;     // Smaller specks are dropped
+    int max_hole_area;          // Enclosed holes up to this size are filled
+    bool tiled_segmentation;    // Segment and clean in L2-sized bands
+    int thread_count;           // Segmentation threads (0 = all cores)
+    int coarse_factor;          // Coarse-to-fine downsampling (1 = off, 4 or 8)
+    bool change_gating;         // Reuse results of unchanged frames, re-segment changed tiles
+    int change_threshold;       // Mean absolute difference per byte that marks a tile changed
+    bool piece_tracking;        // Follow pieces across frames, one verdict each
+    cv::Point2f conveyor_direction;  // Belt motion in the image, (0, 1) = down
+    int track_max_missed;       // Frames a piece may go undetected before its track ends
+    bool belt_stitching;        // Segment only newly exposed belt rows, measure each piece once
 };
 
 class ConfigManager {
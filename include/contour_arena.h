@@ -0,0 +1,81 @@
+#ifndef CONTOUR_ARENA_H
+#define CONTOUR_ARENA_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace country_style {
+
+// Read-only view of one contour's points inside a ContourArena. Valid until
+// the arena is next cleared or appended to.
+struct ContourView {
+    const cv::Point* points;
+    int count;
+    
+    const cv::Point* begin() const { return points; }
+    const cv::Point* end() const { return points + count; }
+    size_t size() const { return static_cast<size_t>(count); }
+    bool empty() const { return count == 0; }
+    const cv::Point& operator[](size_t i) const { return points[i]; }
+    
+    std::vector<cv::Point> toVector() const { return std::vector<cv::Point>(begin(), end()); }
+};
+
+// The contours of one frame in a single flat point buffer, each an offset
+// and length into it. clear() keeps the capacity, so once the buffers have
+// grown to the busiest frame, tracing allocates nothing more.
+class ContourArena {
+public:
+    void clear() {
+        points_.clear();
+        spans_.clear();
+    }
+    
+    // Append points as one contour
+    void add(const cv::Point* points, int count) {
+        spans_.push_back(cv::Vec2i(static_cast<int>(points_.size()), count));
+        points_.insert(points_.end(), points, points + count);
+    }
+    void add(const std::vector<cv::Point>& contour) {
+        add(contour.data(), static_cast<int>(contour.size()));
+    }
+    
+    // Start an empty contour and add points to it one at a time
+    void beginContour() {
+        spans_.push_back(cv::Vec2i(static_cast<int>(points_.size()), 0));
+    }
+    void addPoint(const cv::Point& point) {
+        points_.push_back(point);
+        spans_.back()[1]++;
+    }
+    
+    size_t size() const { return spans_.size(); }
+    ContourView view(size_t i) const {
+        return ContourView{points_.data() + spans_[i][0], spans_[i][1]};
+    }
+    
+    // Views of every contour, in order
+    void views(std::vector<ContourView>& out) const {
+        out.clear();
+        for (size_t i = 0; i < spans_.size(); i++) {
+            out.push_back(view(i));
+        }
+    }
+
+private:
+    std::vector<cv::Point> points_;
+    std::vector<cv::Vec2i> spans_;  // Offset and length into points_
+};
+
+// Closed outline of a contour, as cv::drawContours draws a single contour
+inline void drawContour(cv::Mat& image, const ContourView& contour,
+                        const cv::Scalar& color, int thickness) {
+    if (contour.empty()) return;
+    const cv::Point* points = contour.points;
+    const int count = contour.count;
+    cv::polylines(image, &points, &count, 1, true, color, thickness);
+}
+
+} // namespace country_style
+
+#endif // CONTOUR_ARENA_H
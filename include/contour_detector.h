@@ -3,6 +3,7 @@
 
 #include <opencv2/opencv.hpp>
 #include <vector>
+#include "blob_labeler.h"
 
 namespace country_style {
 
@@ -15,31 +16,42 @@ struct ContourFeatures {
     cv::Point2f center;
 };
 
+// Version of the area and circularity definitions used by measureBlobs.
+// Files that store limits on them save it, so limits from an older version
+// can be converted on load. 1: cv::contourArea and the outer cv::arcLength
+// of the traced contour; 2: pixel count, perimeter including holes.
+constexpr int kMeasurementVersion = 2;
+
+// Convert version 1 area and circularity limits in place, for round pieces.
+// The traced contour runs through boundary pixel centers, so a disc of
+// contour area A covers about A + 2*sqrt(2*A/pi) + 1 pixels; circularity
+// limits scale by that ratio at the geometric mean of the area limits.
+void convertContourAreaLimits(double& min_area, double& max_area,
+                              double& min_circularity, double& max_circularity);
+
 class ContourDetector {
 public:
     ContourDetector();
     ~ContourDetector();
 
-    // Find contours in binary mask
-    std::vector<std::vector<cv::Point>> findContours(const cv::Mat& mask);
-    
-    // Filter contours based on area constraints
-    std::vector<std::vector<cv::Point>> filterByArea(
-        const std::vector<std::vector<cv::Point>>& contours,
-        double min_area, double max_area);
+    // Label the run mask in one pass and measure every blob of at least 100
+    // pixels without tracing any contour, replacing the contents of
+    // features (its buffer is reused). Area is the pixel count and center
+    // the pixel centroid; perimeter and bounding box match the traced
+    // contour. Results are in the frame coordinates of the mask's bounds.
+    void measureBlobs(const RleMask& mask, std::vector<ContourFeatures>& features);
     
-    // Extract features from contours
-    std::vector<ContourFeatures> extractFeatures(
-        const std::vector<std::vector<cv::Point>>& contours);
-    
-    // Draw contours on image
-    cv::Mat drawContours(const cv::Mat& frame,
-                         const std::vector<std::vector<cv::Point>>& contours,
-                         const cv::Scalar& color);
+    // Contour of the blob measured as element index of the last
+    // measureBlobs() result, traced only when asked for and appended to
+    // arena as one contour (empty for a bad index)
+    void traceBlob(size_t index, ContourArena& arena);
 
 private:
-    int retrieval_mode_;
-    int approximation_method_;
+    // Run-based labeling and the blob behind each measured feature
+    BlobLabeler blob_labeler_;
+    std::vector<int> measured_blobs_;
+    
+    void collectFeatures(const std::vector<BlobStats>& blobs, std::vector<ContourFeatures>& features);
 };
 
 } // namespace country_style
@@ -3,27 +3,117 @@
 
 #include <opencv2/opencv.hpp>
 #include <memory>
+#include <vector>
+#include <atomic>
+#include <future>
+#include <cstdint>
 #include "simd_hsv_convert.h"
+#include "roi_polygon.h"
+#include "binary_morphology.h"
+#include "component_filter.h"
+#include "thread_pool.h"
 
 namespace country_style {
 
+// How a frame is turned into a binary mask
+enum class SegmentationMode {
+    HsvThreshold,   // BGR -> HSV buffer -> range test
+    DirectLut       // BGR -> mask via a precomputed 2^24-bit color table
+};
+
+// How cleanMask removes speckle and pinholes
+enum class MaskCleaning {
+    Morphology,     // OPEN x2 then CLOSE x2 (also rounds piece outlines)
+    Components      // Drop small components, fill small holes; outlines untouched
+};
+
+// One box of the HSV color model. Hue wraps through red when
+// lower[0] > upper[0]: H >= lower[0] or H <= upper[0].
+struct HsvRange {
+    cv::Scalar lower;
+    cv::Scalar upper;
+};
+
 class FastColorSegmentation {
 public:
     FastColorSegmentation();
     ~FastColorSegmentation();
     
-    // Set HSV color range for dough detection
+    // Set HSV color range for dough detection. A hue lower bound above the
+    // upper bound wraps through red: H >= lower[0] or H <= upper[0].
     void setColorRange(const cv::Scalar& lower, const cv::Scalar& upper);
     
-    // High-performance segmentation (target: <5ms for 640x480)
-    // Returns binary mask in pre-allocated buffer
-    void segment(const cv::Mat& frame, cv::Mat& mask);
+    // Set a union of up to kMaxColorBoxes HSV boxes (e.g. glazed and
+    // unglazed dough). All boxes are tested in the same pass over the frame.
+    void setColorRanges(const std::vector<HsvRange>& ranges);
+    
+    // High-performance segmentation (target: <5ms for 640x480) into runs:
+    // each row is classified into a one-row buffer and encoded while it is
+    // still in cache. The frame may be an ROI view or a padded camera
+    // buffer; it is read in place. origin is the frame position of the view
+    // and becomes mask.bounds.tl(). With spans, the frame covers
+    // spans->bounds and only pixels inside the spans are converted and
+    // classified; the rest of the mask is empty.
+    void segment(const cv::Mat& frame, RleMask& mask, const RoiSpans* spans = nullptr,
+                 const cv::Point& origin = cv::Point());
+    
+    // Tiled execution for the run path: the frame is processed in horizontal
+    // bands sized so a band's packed mask stays in L2, each band classified
+    // and cleaned while hot. Bands carry enough halo rows that the result is
+    // identical to cleaning the whole frame. Applies to bit-packed
+    // morphology; component cleaning needs whole components and always runs
+    // on the full mask.
+    void setTiledExecution(bool enabled) { tiled_execution_ = enabled; }
+    bool getTiledExecution() const { return tiled_execution_; }
+    
+    // Threads for the run path (1 = calling thread only, 0 = every hardware
+    // thread). The frame is split into at least this many bands, classified
+    // and cleaned in parallel; halo rows are read from the neighbouring
+    // bands' classified rows, so the mask is the same for any thread count.
+    void setThreadCount(int threads);
+    int getThreadCount() const { return thread_pool_ ? thread_pool_->size() : 1; }
+    
+    // Classify plus clean time of each band of the last run-path frame
+    const std::vector<double>& getLastBandTimesMs() const { return band_times_ms_; }
+    int getLastBandCount() const { return static_cast<int>(band_times_ms_.size()); }
+    
+    // Threshold only, no cleaning (e.g. to find candidates in a downsampled
+    // frame). spans and origin as for segment.
+    void classify(const cv::Mat& frame, RleMask& mask, const RoiSpans* spans = nullptr,
+                  const cv::Point& origin = cv::Point());
     
-    // Apply morphological operations (optimized single-pass)
-    void cleanMask(cv::Mat& mask);
+    // Distance in pixels over which cleanMask can change the mask; a region
+    // segmented with this much margin around a piece cleans it exactly as
+    // the full frame would
+    int getCleaningHalo() const;
     
-    // Get current color range
+    // Apply morphological operations: OPEN x2 then CLOSE x2 with an ellipse
+    // of the configured size, on a bit-packed copy of the mask; or, with
+    // MaskCleaning::Components, one labeling pass that drops small
+    // components and fills small holes. The mask is cleaned as a standalone
+    // image of its bounds.
+    void cleanMask(RleMask& mask);
+    
+    // Ellipse diameter for cleanMask (1 disables cleaning)
+    void setMorphKernelSize(int size);
+    int getMorphKernelSize() const { return morph_kernel_size_; }
+    
+    // Select the cleaning used by cleanMask. Components uses the area limits
+    // below instead of the morphology kernel.
+    void setMaskCleaning(MaskCleaning cleaning) { mask_cleaning_ = cleaning; }
+    MaskCleaning getMaskCleaning() const { return mask_cleaning_; }
+    void setComponentLimits(int min_component_area, int max_hole_area);
+    
+    // Get current color range (first box of the color model)
     void getColorRange(cv::Scalar& lower, cv::Scalar& upper) const;
+    const std::vector<HsvRange>& getColorRanges() const { return color_ranges_; }
+    
+    // Select the segmentation path. DirectLut rebuilds its color table in
+    // the background whenever the range changes; until the table for the
+    // current range is ready, frames fall back to HsvThreshold.
+    void setSegmentationMode(SegmentationMode mode);
+    SegmentationMode getSegmentationMode() const { return segmentation_mode_; }
+    bool isColorLutReady();
     
     // Performance statistics
     double getLastProcessingTimeMs() const { return last_processing_time_ms_; }
@@ -32,22 +122,79 @@ private:
     // SIMD-accelerated HSV converter
     std::unique_ptr<SimdHsvConverter> hsv_converter_;
     
-    // Color range bounds
-    cv::Scalar lower_bound_;
-    cv::Scalar upper_bound_;
+    // Color model: union of HSV boxes
+    std::vector<HsvRange> color_ranges_;
     
     // Pre-allocated buffers to avoid memory allocation overhead
-    cv::Mat hsv_buffer_;
+    cv::Mat dense_buffer_;  // Run mask expanded for cv::morphologyEx
+    RleMask clip_buffer_;
     cv::Mat morph_kernel_;
     
     // Morphology settings
     int morph_kernel_size_;
+    BinaryMorphology binary_morphology_;
+    bool use_binary_morphology_;  // Kernel decomposes; else cv::morphologyEx
+    MaskCleaning mask_cleaning_;
+    ComponentFilter component_filter_;
+    bool tiled_execution_;
+    
+    // Band execution of the run path. Bands keep their classified and
+    // cleaned rows; each thread has its own row buffers and morphology.
+    struct Band {
+        RleMask raw;      // The band's own rows, as classified
+        RleMask cleaned;  // Same rows after cleaning
+    };
+    struct BandWorker {
+        cv::Mat hsv_row;   // One row of HSV
+        cv::Mat mask_row;  // One row of mask bytes
+        RleMask window;    // Band plus halo rows being cleaned
+        BinaryMorphology morphology;
+        int kernel_size = 0;  // Kernel morphology was set up for
+    };
+    std::unique_ptr<ThreadPool> thread_pool_;
+    std::vector<Band> bands_;
+    std::vector<BandWorker> band_workers_;
+    std::vector<double> band_times_ms_;
     
     // Performance tracking
     double last_processing_time_ms_;
     
-    // SIMD-optimized inRange operation
-    void inRangeSIMD(const cv::Mat& hsv, cv::Mat& mask);
+    // Direct BGR -> mask color table (2^24 bits = 2 MB)
+    struct ColorLut {
+        std::vector<uint64_t> bits;
+        uint64_t generation;
+    };
+    SegmentationMode segmentation_mode_;
+    std::shared_ptr<const ColorLut> color_lut_;
+    std::future<std::shared_ptr<const ColorLut>> pending_lut_;
+    uint64_t pending_generation_;  // Generation pending_lut_ is building
+    std::atomic<uint64_t> color_generation_;
+    
+    void requestColorLutRebuild();
+    void collectColorLut();
+    std::shared_ptr<const ColorLut> buildColorLut(std::vector<HsvRange> ranges,
+                                                  uint64_t generation);
+    
+    // Classify pixels [begin, end) of frame row y into worker.mask_row
+    void classifyRow(const cv::Mat& frame, int y, int begin, int end, bool use_lut,
+                     const ColorBox* boxes, int box_count, BandWorker& worker);
+    
+    // Classify frame row y (only its spans, if given) and append its runs
+    void appendClassifiedRow(const cv::Mat& frame, int y, const RoiSpans* spans,
+                             bool use_lut, const ColorBox* boxes, int box_count,
+                             BandWorker& worker, std::vector<cv::Vec2i>& runs);
+    
+    // Rows per L2-sized band for a frame width, or 0 when the current
+    // cleaning cannot be done band by band
+    int bandRows(int width) const;
+    int haloRows() const { return 8 * binary_morphology_.reachRows(); }
+    void segmentBands(const cv::Mat& frame, RleMask& mask, const RoiSpans* spans,
+                      int band_rows, bool use_lut, const ColorBox* boxes, int box_count);
+    void cleanBand(int band, int band_rows, int rows, BandWorker& worker);
+    
+    // SIMD-optimized inRange operation over every box at once
+    static void inRangeSIMD(const cv::Mat& hsv, cv::Mat& mask,
+                            const std::vector<HsvRange>& ranges);
 };
 
 } // namespace country_style
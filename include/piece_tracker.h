@@ -0,0 +1,72 @@
+#ifndef PIECE_TRACKER_H
+#define PIECE_TRACKER_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace country_style {
+
+// One piece followed across frames
+struct PieceTrack {
+    int id;              // Persistent, never reused
+    cv::Point2f center;  // Last seen position
+    cv::Rect bbox;
+    float speed;         // Pixels per frame along the conveyor direction
+    int hits;            // Frames the piece was seen in
+    int missed;          // Frames since it was last seen
+};
+
+// Associates detections across frames so each piece on the belt keeps one
+// ID from the frame it enters the inspected area until it leaves.
+//
+// Each track's center and box are moved along the conveyor direction by its
+// measured speed; a detection matches the track whose predicted box it
+// overlaps with the nearest predicted center. Pieces move far less than
+// their own size between frames, so matching is greedy, nearest pair
+// first. Unmatched detections start new tracks. A track ends when its
+// predicted center leaves the area, or when it goes unseen for more than
+// the allowed frames.
+class PieceTracker {
+public:
+    PieceTracker();
+    
+    // Direction the belt moves pieces in the image; normalized, (0, 1) is
+    // down the frame
+    void setDirection(const cv::Point2f& direction);
+    cv::Point2f getDirection() const { return direction_; }
+    
+    // Frames a piece may go undetected inside the area before its track ends
+    void setMaxMissed(int frames);
+    int getMaxMissed() const { return max_missed_; }
+    
+    // Drop every track; IDs keep counting up
+    void reset();
+    
+    // Match this frame's detections (frame coordinates) to the tracks.
+    // track_ids gets the track of each detection, ended the IDs of the
+    // tracks that ended this frame.
+    void update(const std::vector<cv::Point2f>& centers, const std::vector<cv::Rect>& boxes,
+                const cv::Rect& area, std::vector<int>& track_ids, std::vector<int>& ended);
+    
+    const std::vector<PieceTrack>& tracks() const { return tracks_; }
+
+private:
+    cv::Point2f direction_;
+    int max_missed_;
+    int next_id_;
+    std::vector<PieceTrack> tracks_;
+    
+    // Candidate matches of the current frame
+    struct Match {
+        float distance;
+        int track;
+        int detection;
+    };
+    std::vector<Match> matches_;
+    std::vector<int> track_detection_;
+    std::vector<cv::Point2f> predicted_;
+};
+
+} // namespace country_style
+
+#endif // PIECE_TRACKER_H
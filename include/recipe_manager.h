@@ -16,12 +16,12 @@ struct Recipe {
     std::string name;
     std::string description;
     
-    // HSV color range
-    cv::Scalar hsv_lower;
-    cv::Scalar hsv_upper;
+    // HSV color model: union of up to kMaxColorBoxes boxes
+    std::vector<HsvRange> hsv_ranges;
     
-    // Region of interest
+    // Region of interest; polygons replace the rectangle when present
     cv::Rect roi;
+    std::vector<Polygon> roi_polygons;
     
     // Detection rules
     DetectionRules detection_rules;
@@ -29,16 +29,23 @@ struct Recipe {
     // Quality thresholds
     QualityThresholds quality_thresholds;
     
+    // Optional lanes, each with its own thresholds
+    std::vector<InspectionLane> lanes;
+    
     // Processing parameters
     int morph_kernel_size;
     bool enable_preprocessing;
+    bool use_component_filter;  // Component area cleaning instead of morphology
+    int min_component_area;
+    int max_hole_area;
     
     // Metadata
     std::string created_date;
     std::string modified_date;
     std::string created_by;
     
-    Recipe() : morph_kernel_size(5), enable_preprocessing(true) {}
+    Recipe() : morph_kernel_size(5), enable_preprocessing(true),
+               use_component_filter(false), min_component_area(50), max_hole_area(200) {}
 };
 
 // Manages loading, saving, and switching between recipes
@@ -0,0 +1,46 @@
+#ifndef RLE_MASK_H
+#define RLE_MASK_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <cstdint>
+
+namespace country_style {
+
+// Binary mask held as runs of set pixels, one sorted list per row of its
+// bounds. Dough masks are a few large blobs, so a frame is a few thousand
+// runs instead of a dense byte per pixel; the pipeline segments, cleans,
+// clips and labels in this form and only expands it for display.
+struct RleMask {
+    cv::Rect bounds;               // Frame area the mask covers
+    std::vector<int> row_offsets;  // bounds.height + 1 indices into runs
+    std::vector<cv::Vec2i> runs;   // [begin, end) columns relative to bounds.x,
+                                   // never touching within a row
+    
+    // Empty mask (no runs) covering area
+    void reset(const cv::Rect& area);
+    
+    int rowBegin(int y) const { return row_offsets[y]; }
+    int rowEnd(int y) const { return row_offsets[y + 1]; }
+    int64_t pixelCount() const;
+};
+
+// Append the runs of non-zero bytes in row[0, width), with offset added to
+// every column. Skips uniform stretches 8 bytes at a time.
+void appendRowRuns(const uint8_t* row, int width, int offset, std::vector<cv::Vec2i>& runs);
+
+// Dense CV_8UC1 mask (which may be a view) -> runs; bounds gets origin as
+// its top-left
+void encodeMask(const cv::Mat& mask, RleMask& rle, const cv::Point& origin = cv::Point());
+
+// Runs -> 0/255 pixels of a bounds-sized CV_8UC1 mask (or view). Every
+// pixel is written.
+void decodeMask(const RleMask& rle, cv::Mat& mask);
+
+// Keep only the part of the mask inside area (frame coordinates); bounds
+// shrink to the overlap
+void clipMask(RleMask& rle, const cv::Rect& area);
+
+} // namespace country_style
+
+#endif // RLE_MASK_H
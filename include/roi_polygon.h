@@ -0,0 +1,45 @@
+#ifndef ROI_POLYGON_H
+#define ROI_POLYGON_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "rle_mask.h"
+
+namespace country_style {
+
+// Closed polygon in image coordinates. The teaching app draws them as color
+// samples; the pipeline uses them as inspection ROIs.
+struct Polygon {
+    std::vector<cv::Point2f> points;
+    bool is_good_sample;  // true = good dough, false = background/defect
+    cv::Scalar color;
+};
+
+// Polygon ROI rasterized into horizontal runs, one list per row of its
+// bounding box. Built once per polygon and frame size, then reused for
+// every frame.
+struct RoiSpans {
+    cv::Rect bounds;               // Frame area covered by the polygons
+    std::vector<int> row_offsets;  // bounds.height + 1 indices into spans
+    std::vector<cv::Vec2i> spans;  // [begin, end) columns relative to bounds.x
+    
+    bool empty() const { return bounds.area() <= 0; }
+};
+
+// Rasterize the union of polygons clipped to the frame. Polygons with fewer
+// than three points are ignored.
+void rasterizeRoiPolygons(const std::vector<Polygon>& polygons,
+                          const cv::Size& frame_size, RoiSpans& spans);
+
+// Clear every pixel of a run mask over the spans' bounds that lies outside
+// the spans. A run can cross several spans, so the result goes to a
+// separate mask.
+void clearOutsideSpans(const RleMask& mask, const RoiSpans& spans, RleMask& clipped);
+
+// Part of the spans inside area (frame coordinates), with cropped.bounds set
+// to area so it can drive segmentation of frame(area)
+void cropSpans(const RoiSpans& spans, const cv::Rect& area, RoiSpans& cropped);
+
+} // namespace country_style
+
+#endif // ROI_POLYGON_H
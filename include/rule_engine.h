@@ -5,6 +5,7 @@
 #include <vector>
 #include <string>
 #include "contour_detector.h"
+#include "rule_program.h"
 
 namespace country_style {
 
@@ -36,6 +37,10 @@ public:
     // Validate individual contour
     bool validateContour(const ContourFeatures& feature);
     
+    // Validate every detection of a frame at once with the compiled rules:
+    // rejected[i] is non-zero when detection i breaks any rule
+    void validateContours(const FeatureColumns& columns, std::vector<uint32_t>& rejected) const;
+    
     // Get rule validation results
     std::string getValidationMessage() const;
     
@@ -44,8 +49,11 @@ public:
 
 private:
     DetectionRules rules_;
+    RuleProgram program_;  // rules_ compiled, rebuilt by setRules
     std::string validation_message_;
     
+    void compileRules();
+    
     bool validateArea(double area);
     bool validateCircularity(double circularity);
     bool validateAspectRatio(double ratio);
@@ -0,0 +1,61 @@
+#ifndef RULE_PROGRAM_H
+#define RULE_PROGRAM_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "simd_kernels.h"
+
+namespace country_style {
+
+// Features a rule program can test, one column each
+enum class FeatureColumn {
+    Area,
+    Width,
+    Height,
+    AspectRatio,
+    Circularity,
+    Count
+};
+
+constexpr int kFeatureColumnCount = static_cast<int>(FeatureColumn::Count);
+
+// Detection features as structure of arrays, so one check reads a
+// contiguous run of values. Values are floats: 8 fit one AVX2 register.
+struct FeatureColumns {
+    std::vector<float> values[kFeatureColumnCount];
+    
+    // Every column gets count values; the buffers are kept between frames
+    void resize(size_t count);
+    size_t size() const { return values[0].size(); }
+    
+    float* column(FeatureColumn c) { return values[static_cast<int>(c)].data(); }
+};
+
+// Limit checks compiled from a rule set whenever it changes, and then run
+// over every detection of a frame in one pass with the SIMD kernels.
+// Disabled checks and unset (zero) limits are left out at compile time, so
+// evaluating does no tests beyond the ones that can fail.
+class RuleProgram {
+public:
+    void clear();
+    
+    // Fail detections whose column value is below limit, or above it when
+    // upper is set, with flag
+    void addCheck(FeatureColumn column, bool upper, double limit, uint32_t flag);
+    
+    bool empty() const { return checks_.empty(); }
+    const std::vector<LimitCheck>& checks() const { return checks_; }
+    double limit(size_t check) const { return limits_[check]; }  // As given, before float
+    
+    // faults[i] gets the flags of every check detection i fails
+    void evaluate(const FeatureColumns& columns, std::vector<uint32_t>& faults) const;
+
+private:
+    std::vector<LimitCheck> checks_;
+    std::vector<double> limits_;
+};
+
+} // namespace country_style
+
+#endif // RULE_PROGRAM_H
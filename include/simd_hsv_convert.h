@@ -3,35 +3,46 @@
 
 #include <opencv2/opencv.hpp>
 #include <cstdint>
+#include "simd_kernels.h"
 
 namespace country_style {
 
-// SIMD-optimized BGR to HSV conversion using AVX2
+// SIMD-optimized BGR to HSV conversion (runtime-selected instruction set)
+//
+// Output is bit-exact with cv::cvtColor(COLOR_BGR2HSV) for 8-bit images:
+// both paths use OpenCV's fixed-point reciprocal tables (12-bit shift), so
+// HSV ranges taught on either path select exactly the same pixels.
 class SimdHsvConverter {
 public:
     SimdHsvConverter();
     ~SimdHsvConverter();
     
-    // Convert BGR to HSV with SIMD acceleration
+    // Convert BGR to HSV with SIMD acceleration. Input and output may be
+    // ROI views or row-padded buffers (Mat::step is honoured, no copies).
     void convertBgrToHsv(const cv::Mat& bgr, cv::Mat& hsv);
     
     // Build lookup tables for faster conversion (call once at startup)
     void buildLookupTables();
     
+    // Direct BGR -> binary mask through a 2^24-bit color membership table.
+    // Bit (r << 16 | g << 8 | b) of lut_bits is set for colors inside the
+    // range; mask pixels are written as 0 or 255 and no HSV image is formed.
+    void convertBgrToMaskLut(const cv::Mat& bgr, const uint64_t* lut_bits, cv::Mat& mask);
+    
     // Check if AVX2 is available
     static bool hasAvx2Support();
     
+    // Instruction set level of the kernels in use
+    SimdLevel getSimdLevel() const { return kernels_->level; }
+
 private:
-    // LUT-based conversion (fallback or hybrid approach)
-    void convertBgrToHsvLut(const cv::Mat& bgr, cv::Mat& hsv);
-    
-    // Pure SIMD implementation
-    void convertBgrToHsvAvx2(const uint8_t* bgr, uint8_t* hsv, int pixels);
+    // Kernels for the instruction set selected at startup
+    const SimdKernels* kernels_;
     
-    // Lookup tables for fast conversion
-    uint8_t* hue_lut_;
-    uint8_t* sat_lut_;
-    bool use_avx2_;
+    // Fixed-point reciprocal tables indexed by 8-bit delta (hue) and
+    // value (saturation): round((180 << 12) / (6 * i)), round((255 << 12) / i)
+    int32_t* hue_lut_;
+    int32_t* sat_lut_;
 };
 
 } // namespace country_style
@@ -0,0 +1,93 @@
+#ifndef SIMD_INTERLEAVE_H
+#define SIMD_INTERLEAVE_H
+
+#include <immintrin.h>
+#include <cstdint>
+
+// Shared AVX2 helpers for packed 3-channel 8-bit pixels (BGR or HSV).
+// Functions are static so that translation units built for different
+// instruction sets never share one out-of-line copy.
+
+#ifdef __AVX2__
+namespace country_style {
+
+// Bytes at position 1 or 2 (mod 3) of each 16-byte lane, used to route the
+// channels of 16 packed 3-byte pixels between registers
+static inline __m256i laneMaskMod3(int phase) {
+    return phase == 1
+        ? _mm256_setr_epi8(0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0,
+                           0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0)
+        : _mm256_setr_epi8(0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0,
+                           0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0);
+}
+
+// Split 32 packed 3-channel pixels (96 bytes) into one register per channel.
+// Lane 0 of each output holds pixels 0-15, lane 1 holds pixels 16-31.
+static inline void loadDeinterleave32(const uint8_t* src, __m256i& c0, __m256i& c1, __m256i& c2) {
+    __m256i in0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+    __m256i in1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32));
+    __m256i in2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 64));
+    
+    // Regroup so each 128-bit lane holds 48 contiguous bytes (16 pixels)
+    __m256i x = _mm256_permute2x128_si256(in0, in1, 0x30);  // bytes 0-15  | 48-63
+    __m256i y = _mm256_permute2x128_si256(in0, in2, 0x21);  // bytes 16-31 | 64-79
+    __m256i z = _mm256_permute2x128_si256(in1, in2, 0x30);  // bytes 32-47 | 80-95
+    
+    const __m256i m1 = laneMaskMod3(1);
+    const __m256i m2 = laneMaskMod3(2);
+    
+    // Collect each channel's bytes into one register (still permuted)
+    __m256i t0 = _mm256_blendv_epi8(_mm256_blendv_epi8(x, y, m2), z, m1);
+    __m256i t1 = _mm256_blendv_epi8(_mm256_blendv_epi8(y, x, m1), z, m2);
+    __m256i t2 = _mm256_blendv_epi8(_mm256_blendv_epi8(z, x, m2), y, m1);
+    
+    const __m256i sh0 = _mm256_setr_epi8(
+        0, 3, 6, 9, 12, 15, 2, 5, 8, 11, 14, 1, 4, 7, 10, 13,
+        0, 3, 6, 9, 12, 15, 2, 5, 8, 11, 14, 1, 4, 7, 10, 13);
+    const __m256i sh1 = _mm256_setr_epi8(
+        1, 4, 7, 10, 13, 0, 3, 6, 9, 12, 15, 2, 5, 8, 11, 14,
+        1, 4, 7, 10, 13, 0, 3, 6, 9, 12, 15, 2, 5, 8, 11, 14);
+    const __m256i sh2 = _mm256_setr_epi8(
+        2, 5, 8, 11, 14, 1, 4, 7, 10, 13, 0, 3, 6, 9, 12, 15,
+        2, 5, 8, 11, 14, 1, 4, 7, 10, 13, 0, 3, 6, 9, 12, 15);
+    
+    c0 = _mm256_shuffle_epi8(t0, sh0);
+    c1 = _mm256_shuffle_epi8(t1, sh1);
+    c2 = _mm256_shuffle_epi8(t2, sh2);
+}
+
+// Inverse of loadDeinterleave32
+static inline void storeInterleave32(uint8_t* dst, __m256i c0, __m256i c1, __m256i c2) {
+    const __m256i sh0 = _mm256_setr_epi8(
+        0, 11, 6, 1, 12, 7, 2, 13, 8, 3, 14, 9, 4, 15, 10, 5,
+        0, 11, 6, 1, 12, 7, 2, 13, 8, 3, 14, 9, 4, 15, 10, 5);
+    const __m256i sh1 = _mm256_setr_epi8(
+        5, 0, 11, 6, 1, 12, 7, 2, 13, 8, 3, 14, 9, 4, 15, 10,
+        5, 0, 11, 6, 1, 12, 7, 2, 13, 8, 3, 14, 9, 4, 15, 10);
+    const __m256i sh2 = _mm256_setr_epi8(
+        10, 5, 0, 11, 6, 1, 12, 7, 2, 13, 8, 3, 14, 9, 4, 15,
+        10, 5, 0, 11, 6, 1, 12, 7, 2, 13, 8, 3, 14, 9, 4, 15);
+    
+    __m256i t0 = _mm256_shuffle_epi8(c0, sh0);
+    __m256i t1 = _mm256_shuffle_epi8(c1, sh1);
+    __m256i t2 = _mm256_shuffle_epi8(c2, sh2);
+    
+    const __m256i m1 = laneMaskMod3(1);
+    const __m256i m2 = laneMaskMod3(2);
+    
+    __m256i x = _mm256_blendv_epi8(_mm256_blendv_epi8(t0, t1, m1), t2, m2);
+    __m256i y = _mm256_blendv_epi8(_mm256_blendv_epi8(t1, t2, m1), t0, m2);
+    __m256i z = _mm256_blendv_epi8(_mm256_blendv_epi8(t2, t0, m1), t1, m2);
+    
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst),
+                        _mm256_permute2x128_si256(x, y, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 32),
+                        _mm256_permute2x128_si256(z, x, 0x30));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 64),
+                        _mm256_permute2x128_si256(y, z, 0x31));
+}
+
+} // namespace country_style
+#endif // __AVX2__
+
+#endif // SIMD_INTERLEAVE_H
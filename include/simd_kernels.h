@@ -0,0 +1,94 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <cstdint>
+
+namespace country_style {
+
+// Instruction set levels the pixel kernels are compiled for
+enum class SimdLevel {
+    Scalar,
+    Sse41,
+    Avx2,
+    Avx512bw
+};
+
+const char* simdLevelName(SimdLevel level);
+
+// One 8-bit HSV box. Channel 0 (hue) wraps when lower[0] > upper[0]:
+// x >= lower || x <= upper.
+struct ColorBox {
+    uint8_t lower[3];
+    uint8_t upper[3];
+};
+
+// Most boxes a single range-test pass accepts
+constexpr int kMaxColorBoxes = 8;
+
+// One compiled rule: a detection whose value in column is below limit
+// (above it when upper is set) fails with flag
+struct LimitCheck {
+    int column;
+    bool upper;
+    float limit;
+    uint32_t flag;
+};
+
+// Pixel kernels for one instruction set level.
+//
+// Each level lives in its own translation unit (simd_kernels_<level>.cpp)
+// built with only that level's compiler flags, so the binary runs on any
+// x86-64 CPU and picks the best path at startup.
+struct SimdKernels {
+    SimdLevel level;
+    
+    // BGR -> HSV, bit-exact with cv::cvtColor(COLOR_BGR2HSV). May be null,
+    // in which case callers use cv::cvtColor (itself runtime-dispatched).
+    void (*bgr_to_hsv)(const uint8_t* bgr, uint8_t* hsv, int pixels,
+                       const int32_t* hue_lut, const int32_t* sat_lut);
+    
+    // BGR -> 0/255 mask through a 2^24-bit color membership table
+    void (*bgr_to_mask_lut)(const uint8_t* bgr, uint8_t* mask, int pixels,
+                            const uint64_t* lut_bits);
+    
+    // 0/255 mask of 3-channel pixels inside any of the boxes
+    // (box_count <= kMaxColorBoxes), tested in a single pass
+    void (*in_range)(const uint8_t* src, uint8_t* mask, int pixels,
+                     const ColorBox* boxes, int box_count);
+    
+    // Sum of |a[i] - b[i]| over bytes (change detection between frames)
+    uint64_t (*sum_abs_diff)(const uint8_t* a, const uint8_t* b, int bytes);
+    
+    // faults[i] = flags of the checks detection i fails, for i in
+    // [first, count); columns[c] holds feature c of every detection
+    void (*check_limits)(const float* const* columns, int first, int count,
+                         const LimitCheck* checks, int check_count, uint32_t* faults);
+};
+
+// Highest level supported by this CPU (and OS register saving)
+SimdLevel detectSimdLevel();
+
+// Kernels for the detected level; selected and logged on first use
+const SimdKernels& simdKernels();
+
+// Per-level tables, null when the level was not compiled into this build.
+// Only call the getter of a level the CPU supports.
+const SimdKernels* scalarKernels();
+const SimdKernels* sse41Kernels();
+const SimdKernels* avx2Kernels();
+const SimdKernels* avx512Kernels();
+
+// Portable kernels, also used by the SIMD levels for loop tails
+void bgrToHsvScalar(const uint8_t* bgr, uint8_t* hsv, int pixels,
+                    const int32_t* hue_lut, const int32_t* sat_lut);
+void bgrToMaskLutScalar(const uint8_t* bgr, uint8_t* mask, int pixels,
+                        const uint64_t* lut_bits);
+void inRangeScalar(const uint8_t* src, uint8_t* mask, int pixels,
+                   const ColorBox* boxes, int box_count);
+uint64_t sumAbsDiffScalar(const uint8_t* a, const uint8_t* b, int bytes);
+void checkLimitsScalar(const float* const* columns, int first, int count,
+                       const LimitCheck* checks, int check_count, uint32_t* faults);
+
+} // namespace country_style
+
+#endif // SIMD_KERNELS_H
@@ -0,0 +1,53 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+namespace country_style {
+
+// Fixed set of worker threads for splitting one frame's work into tasks.
+// Threads are started once and sleep between batches, so a batch costs a
+// wake-up rather than a thread launch.
+class ThreadPool {
+public:
+    // threads counts the calling thread; 0 uses every hardware thread
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+    
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    int size() const { return static_cast<int>(workers_.size()) + 1; }
+    
+    // Run task(index, worker) for every index in [0, count) and return when
+    // all are done. The caller takes part as worker 0; worker is below
+    // size(), so it can pick per-thread scratch buffers.
+    void parallelFor(int count, const std::function<void(int, int)>& task);
+
+private:
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+    
+    // Current batch
+    const std::function<void(int, int)>* task_;
+    int count_;
+    std::atomic<int> next_;
+    int active_;  // Workers still in the batch
+    uint64_t generation_;
+    bool stop_;
+    
+    void workerLoop(int worker);
+    void runTasks(int worker);
+};
+
+} // namespace country_style
+
+#endif // THREAD_POOL_H
@@ -4,13 +4,37 @@
 #include <opencv2/opencv.hpp>
 #include <memory>
 #include <vector>
+#include <string>
 #include <chrono>
 #include "fast_color_segmentation.h"
 #include "contour_detector.h"
 #include "rule_engine.h"
+#include "roi_polygon.h"
+#include "piece_tracker.h"
+#include "belt_stitcher.h"
+#include "rule_program.h"
 
 namespace country_style {
 
+// Size and shape checks a detection can fail
+enum class DetectionFault {
+    AreaTooSmall,
+    AreaTooLarge,
+    WidthTooSmall,
+    WidthTooLarge,
+    LengthTooSmall,
+    LengthTooLarge,
+    AspectRatioTooLow,
+    AspectRatioTooHigh,
+    CircularityTooLow,
+    CircularityTooHigh,
+    Count
+};
+
+constexpr uint32_t faultBit(DetectionFault fault) {
+    return 1u << static_cast<int>(fault);
+}
+
 // Individual detection measurements
 struct DetectionMeasurement {
     int id;
@@ -21,8 +45,21 @@ struct DetectionMeasurement {
     double circularity;
     cv::Point2f center;
     cv::Rect bbox;
-    bool meets_specs;  // Individual pass/fail
-    std::string fault_reason;
+    bool meets_specs;  // Individual pass/fail: no fault bits set
+    uint32_t faults;   // faultBit() of every failed check
+    double fault_limits[static_cast<int>(DetectionFault::Count)];  // Limit each failed
+                                                                    // check broke
+    int lane;          // Index into DetectionResult::lanes, -1 outside every lane
+    int track_id;      // Persistent piece ID across frames, -1 without tracking
+};
+
+// Final verdict of one tracked piece, emitted once when it leaves the
+// inspected area
+struct TrackedPiece {
+    DetectionMeasurement measurement;  // Frame it was judged on
+    int frames_seen;
+    bool complete;  // Judged while wholly inside the area; otherwise on its
+                    // largest partial view
 };
 
 // Quality thresholds for fault detection
@@ -62,32 +99,79 @@ struct QualityThresholds {
     bool fail_on_shape_defects;
 };
 
+// Named lane of a multi-lane belt. A detection belongs to the first lane
+// whose region contains its center and is judged against that lane's
+// thresholds instead of the global ones.
+struct InspectionLane {
+    std::string name;
+    Polygon region;
+    QualityThresholds thresholds;
+};
+
+// Count and verdict of one lane
+struct LaneResult {
+    std::string name;
+    int dough_count;
+    bool is_valid;
+    
+    // Fault flags; undersized, oversized and shape defect are set by any
+    // detection with the matching fault bits
+    bool fault_count_low;
+    bool fault_count_high;
+    int count_limit;       // Limit its own count broke, -1 for none
+    bool count_expected;   // count_limit is the expected count, not a min or max
+    bool fault_undersized;
+    bool fault_oversized;
+    bool fault_shape_defect;
+};
+
 struct DetectionResult {
-    std::vector<std::vector<cv::Point>> contours;
-    std::vector<cv::Rect> bounding_boxes;
-    std::vector<cv::Point2f> centers;
-    std::vector<DetectionMeasurement> measurements;  // Detailed per-detection data
+    std::vector<ContourView> contours;  // Into the pipeline's contour arena; valid until
+                                        // its next processFrame
+    std::vector<DetectionMeasurement> measurements;  // Per-detection data, incl. bbox and center
+    std::vector<LaneResult> lanes;  // One entry per configured lane, same order
+    RleMask mask;  // Cleaned mask of the inspected area as runs
+    std::vector<TrackedPiece> finished_pieces;  // Pieces that left the area this frame
     
     int dough_count;
     bool is_valid;  // Overall pass/fail
     double confidence;
     std::string message;
     
-    // Fault flags
+    // Fault flags; undersized, oversized and shape defect are set by any
+    // detection with the matching fault bits
     bool fault_count_low;
     bool fault_count_high;
+    int count_limit;       // Limit its own count broke, -1 for none
+    bool count_expected;   // count_limit is the expected count, not a min or max
     bool fault_undersized;
     bool fault_oversized;
     bool fault_shape_defect;
-    std::vector<std::string> fault_messages;
     
     // Performance metrics
     double segmentation_time_ms;
+    std::vector<double> band_times_ms;  // Classify + clean time of each band
+    double full_res_fraction;  // Share of the inspected area segmented at full resolution
+    bool reused;           // Frame unchanged: this is the previous result again
+    double dirty_fraction; // Share of the inspected area's tiles re-segmented
     double contour_time_ms;
     double rule_time_ms;
     double total_time_ms;
 };
 
+// Readable fault text, formatted from the fault bits only when a display
+// or a log asks for it; processFrame itself does no string work
+
+// Measured value a check compared against its limit
+double faultValue(const DetectionMeasurement& meas, DetectionFault fault);
+
+// Failed checks of one detection, e.g. "Area too small (812px², min 1000px²)"
+std::string describeFaults(const DetectionMeasurement& meas);
+
+// Every fault of a frame: its count and the detections outside every lane,
+// then each lane's, prefixed with the lane name
+std::vector<std::string> faultMessages(const DetectionResult& result);
+
 class VisionPipeline {
 public:
     VisionPipeline();
@@ -99,16 +183,76 @@ public:
     // Process a single frame (target: <10ms total)
     DetectionResult processFrame(const cv::Mat& frame);
     
+    // Same, into a result the caller keeps across frames: its vectors and
+    // strings are overwritten in place, so once they have grown to the
+    // busiest frame, processing allocates nothing
+    void processFrame(const cv::Mat& frame, DetectionResult& result);
+    
     // Update configuration parameters
     void updateColorRange(const cv::Scalar& lower, const cv::Scalar& upper);
+    void updateColorRanges(const std::vector<HsvRange>& ranges);
     void updateROI(const cv::Rect& roi);
+    void updateCropToROI(bool enabled);  // Segment only the ROI (default on)
+    
+    // Polygon ROI (union of polygons). When set it replaces the rectangle:
+    // only pixels inside the polygons are converted and classified. Pass an
+    // empty list to go back to the rectangle.
+    void updateROIPolygons(const std::vector<Polygon>& polygons);
+    
+    // Lanes judged separately within the same pass; empty disables lanes
+    void updateLanes(const std::vector<InspectionLane>& lanes);
     void updateDetectionRules(const DetectionRules& rules);
     void updateQualityThresholds(const QualityThresholds& thresholds);
+    void updateSegmentationMode(SegmentationMode mode);
+    void updateMorphKernelSize(int size);
+    void updateMaskCleaning(MaskCleaning cleaning);
+    void updateComponentLimits(int min_component_area, int max_hole_area);
+    void updateTiledSegmentation(bool enabled);
+    void updateThreadCount(int threads);  // 0 = every hardware thread
+    
+    // Coarse-to-fine detection: find candidates in a frame downsampled by
+    // factor (4 or 8), then segment and measure only their dilated boxes at
+    // full resolution. Measurements stay in full-resolution pixels. 1
+    // disables it. Pieces too small to show up after downsampling are not
+    // found.
+    void updateCoarseToFine(int factor);
+    int getCoarseFactor() const { return coarse_factor_; }
+    
+    // Changed-frame gating: every 4th row of each 64x64 tile is compared
+    // with the frame the tile was last segmented from. If no tile's mean
+    // absolute difference (per channel byte) exceeds threshold, the previous
+    // result is returned with reused set; otherwise only the changed tiles
+    // are re-segmented when the cleaning allows it. Any settings change
+    // forces a full frame.
+    void updateChangeGating(bool enabled, int threshold);
+    
+    // Piece tracking: detections are matched across frames so each piece
+    // keeps one track_id, is judged once when it is wholly inside the area
+    // and keeps that verdict, and is reported once in finished_pieces when
+    // it leaves. direction is the belt's motion in the image.
+    void updateTracking(bool enabled, const cv::Point2f& direction, int max_missed);
+    bool getTracking() const { return tracking_; }
+    int getPiecesCounted() const { return pieces_counted_; }
+    int getPiecesFailed() const { return pieces_failed_; }
+    
+    // Belt stitching for a belt moving pieces down (direction +1) or up
+    // (-1) the frame: the belt displacement is measured each frame and only
+    // the newly exposed rows are segmented into a rolling belt mask. Each
+    // frame's detections are the pieces that became whole in it, so every
+    // piece is measured and counted exactly once; pieces already cut off
+    // when stitching starts are skipped. Replaces change gating,
+    // coarse-to-fine and tracking while on.
+    void updateBeltStitching(bool enabled, int direction);
+    bool getBeltStitching() const { return belt_stitching_; }
     
     // Get intermediate processing results
-    const cv::Mat& getSegmentedMask() const { return segmented_mask_; }
+    const cv::Mat& getSegmentedMask() const;  // Dense copy, built on first call per frame
+    const RleMask& getMaskRuns() const { return mask_runs_; }
     const cv::Mat& getHsvFrame() const { return hsv_frame_; }
     cv::Rect getROI() const { return roi_; }
+    bool getCropToROI() const { return crop_to_roi_; }
+    const std::vector<Polygon>& getROIPolygons() const { return roi_polygons_; }
+    const std::vector<InspectionLane>& getLanes() const { return lanes_; }
     
     // Render detection overlay on frame
     void renderDetections(cv::Mat& frame, const DetectionResult& result);
@@ -121,6 +265,9 @@ public:
         double min_total_ms;
         double max_total_ms;
         int frame_count;
+        std::string simd_path;  // Instruction set chosen for the pixel kernels
+        int thread_count;       // Segmentation threads
+        std::vector<double> last_band_ms;  // Per-band times of the last frame
     };
     
     PerformanceStats getPerformanceStats() const;
@@ -133,20 +280,113 @@ private:
     std::unique_ptr<RuleEngine> rule_engine_;
     
     // Processing state
-    cv::Mat segmented_mask_;
+    RleMask mask_runs_;  // Cleaned mask of the work area, frame coordinates
+    mutable cv::Mat segmented_mask_;
+    mutable bool segmented_mask_stale_;
+    cv::Size mask_frame_size_;
     cv::Mat hsv_frame_;
     cv::Rect roi_;
     bool is_initialized_;
+    bool crop_to_roi_;
+    
+    // Polygon ROI and its rasterized spans (rebuilt on change or resize)
+    std::vector<Polygon> roi_polygons_;
+    RoiSpans roi_spans_;
+    cv::Size roi_spans_size_;
+    bool roi_spans_dirty_;
+    
+    // Coarse-to-fine state
+    int coarse_factor_;
+    cv::Mat coarse_frame_;
+    RleMask coarse_mask_;
+    BlobLabeler coarse_labeler_;
+    std::vector<cv::Rect> fine_boxes_;
+    std::vector<RleMask> fine_masks_;
+    RoiSpans fine_spans_;
+    
+    // Segment the candidate boxes into mask_runs_; returns the fraction of
+    // work_area they cover
+    double segmentCoarseToFine(const cv::Mat& frame, const cv::Rect& work_area, bool use_polygons);
+    
+    // Changed-frame gating state
+    bool change_gating_;
+    int change_threshold_;
+    bool gate_valid_;          // Reference and last result match the settings
+    cv::Mat gate_reference_;   // Sampled rows of each tile when last segmented
+    int gate_cols_;
+    int gate_rows_;
+    std::vector<uint8_t> dirty_tiles_;
+    DetectionResult last_result_;
+    RleMask splice_mask_;
+    std::vector<cv::Vec2i> row_runs_;
+    std::vector<cv::Rect> splice_areas_;
+    
+    // Marks the tiles overlapping work_area that changed; returns how many
+    // did and how many were checked
+    int findDirtyTiles(const cv::Mat& frame, const cv::Rect& work_area, int& checked);
+    void updateGateReference(const cv::Mat& frame, bool dirty_only);
+    void resegmentDirtyTiles(const cv::Mat& frame, const cv::Rect& work_area, bool use_polygons);
+    void invalidateGate() { gate_valid_ = false; }
+    void recordTiming(const DetectionResult& result);
+    
+    // Piece tracking state; open pieces are found by track ID in a list
+    // that keeps its capacity, so pieces come and go without allocating
+    struct OpenPiece {
+        int track_id;
+        TrackedPiece piece;
+    };
+    bool tracking_;
+    PieceTracker piece_tracker_;
+    std::vector<OpenPiece> open_pieces_;
+    std::vector<cv::Point2f> track_centers_;
+    std::vector<cv::Rect> track_boxes_;
+    std::vector<int> track_ids_;
+    std::vector<int> ended_tracks_;
+    int pieces_counted_;
+    int pieces_failed_;
+    
+    // Belt stitching state
+    bool belt_stitching_;
+    BeltStitcher belt_stitcher_;
+    RleMask stitch_strip_;
+    RoiSpans stitch_spans_;
+    
+    // Segment the newly exposed rows and put the pieces completed this frame
+    // into mask_runs_; returns the fraction of work_area segmented
+    double segmentBeltStrip(const cv::Mat& frame, const cv::Rect& work_area, bool use_polygons);
+    
+    // Assign track IDs, reuse the verdicts of judged pieces and judge the
+    // rest; ended pieces go to result.finished_pieces
+    void trackPieces(std::vector<DetectionMeasurement>& measurements, const cv::Rect& work_area,
+                     DetectionResult& result);
+    TrackedPiece& openPiece(int track_id);
+    
+    // Lane regions for per-lane counts and verdicts
+    std::vector<InspectionLane> lanes_;
+    int findLane(const cv::Point2f& center) const;
     QualityThresholds quality_thresholds_;
     
+    // Threshold sets compiled into fault checks, the global one first and
+    // then each lane's; rebuilt whenever thresholds or lanes change
+    std::vector<RuleProgram> quality_programs_;
+    void compileQualityPrograms();
+    
+    // Blob features as columns for the compiled checks, and their results
+    FeatureColumns feature_columns_;
+    std::vector<uint32_t> rejected_;
+    std::vector<std::vector<uint32_t>> quality_faults_;
+    
     // Pre-allocated buffers for zero-copy operations
     cv::Mat roi_frame_;
-    std::vector<std::vector<cv::Point>> temp_contours_;
+    std::vector<ContourFeatures> features_;  // Every blob of the last frame
+    std::vector<size_t> valid_blobs_;        // Index into features_ of each detection
+    ContourArena contour_arena_;  // Contours of the last processed frame
     
     // Performance tracking
     std::vector<double> frame_times_;
     std::vector<double> segmentation_times_;
     std::vector<double> contour_times_;
+    std::vector<double> last_band_times_ms_;
     
     // Helper for timing
     class Timer {
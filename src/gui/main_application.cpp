@@ -127,7 +127,7 @@ void MainApplication::run() {
                     }
                     
                     // Process frame through vision pipeline
-                    last_result_ = vision_pipeline_->processFrame(current_frame_);
+                    vision_pipeline_->processFrame(current_frame_, last_result_);
                     
                     // Render detections on frame
                     vision_pipeline_->renderDetections(current_frame_, last_result_);
@@ -141,7 +141,7 @@ void MainApplication::run() {
                             if (camera_->captureFrame(current_frame_)) {
                                 video_last_frame_time_ = now;
                                 video_finished_ = false;
-                                last_result_ = vision_pipeline_->processFrame(current_frame_);
+                                vision_pipeline_->processFrame(current_frame_, last_result_);
                                 vision_pipeline_->renderDetections(current_frame_, last_result_);
                             }
                         } else {
@@ -507,6 +507,12 @@ void MainApplication::renderPerformanceStats() {
     auto stats = vision_pipeline_->getPerformanceStats();
     
     ImGui::Text("Frame Count: %d", stats.frame_count);
+    ImGui::Text("SIMD Path: %s", stats.simd_path.c_str());
+    ImGui::Text("Threads: %d, bands: %d", stats.thread_count,
+                static_cast<int>(stats.last_band_ms.size()));
+    for (size_t b = 0; b < stats.last_band_ms.size(); b++) {
+        ImGui::Text("  Band %d: %.2f ms", static_cast<int>(b), stats.last_band_ms[b]);
+    }
     ImGui::Separator();
     
     ImGui::Text("Average Total: %.2f ms", stats.avg_total_ms);
@@ -22,17 +22,12 @@
 #include <nlohmann/json.hpp>
 #include "vision_pipeline.h"
 #include "recipe_manager.h"
+#include "roi_polygon.h"
 
 using json = nlohmann::json;
 
 namespace country_style {
 
-struct Polygon {
-    std::vector<cv::Point2f> points;
-    bool is_good_sample;  // true = good dough, false = background/defect
-    cv::Scalar color;
-};
-
 class PolygonTeachingApp {
 public:
     PolygonTeachingApp() 
@@ -1027,6 +1022,11 @@ private:
                 ImGui::Separator();
                 
                 ImGui::Text("Dough Count: %d", last_result_.dough_count);
+                if (vision_pipeline_->getTracking() || vision_pipeline_->getBeltStitching()) {
+                    ImGui::Text("Pieces Counted: %d (%d failed)",
+                                vision_pipeline_->getPiecesCounted(),
+                                vision_pipeline_->getPiecesFailed());
+                }
                 
                 // Status with color coding
                 if (last_result_.is_valid) {
@@ -1035,12 +1035,22 @@ private:
                     ImGui::TextColored(ImVec4(1, 0, 0, 1), "Status: FAIL ✗");
                 }
                 
+                // Per-lane counts
+                for (const auto& lane : last_result_.lanes) {
+                    ImVec4 lane_color = lane.is_valid ? ImVec4(0, 1, 0, 1) : ImVec4(1, 0, 0, 1);
+                    ImGui::TextColored(lane_color, "  %s: %d %s", lane.name.c_str(), lane.dough_count,
+                                       lane.is_valid ? "PASS" : "FAIL");
+                }
+                
                 // Show fault flags if any
-                if (!last_result_.is_valid && !last_result_.fault_messages.empty()) {
-                    ImGui::Spacing();
-                    ImGui::TextColored(ImVec4(1, 0.5, 0, 1), "FAULTS:");
-                    for (const auto& fault : last_result_.fault_messages) {
-                        ImGui::TextWrapped(" • %s", fault.c_str());
+                if (!last_result_.is_valid) {
+                    const std::vector<std::string> faults = faultMessages(last_result_);
+                    if (!faults.empty()) {
+                        ImGui::Spacing();
+                        ImGui::TextColored(ImVec4(1, 0.5, 0, 1), "FAULTS:");
+                        for (const auto& fault : faults) {
+                            ImGui::TextWrapped(" • %s", fault.c_str());
+                        }
                     }
                 }
                 
@@ -1124,6 +1134,19 @@ private:
                 ImGui::Text("Performance:");
                 ImGui::Text(" Total: %.2f ms", last_result_.total_time_ms);
                 ImGui::Text(" Segmentation: %.2f ms", last_result_.segmentation_time_ms);
+                if (last_result_.reused) {
+                    ImGui::Text(" Frame unchanged: previous result reused");
+                } else if (last_result_.dirty_fraction < 1.0) {
+                    ImGui::Text(" Changed tiles: %.1f%%", last_result_.dirty_fraction * 100.0);
+                }
+                if (vision_pipeline_->getCoarseFactor() > 1) {
+                    ImGui::Text(" Full resolution: %.1f%% of area",
+                                last_result_.full_res_fraction * 100.0);
+                }
+                for (size_t b = 0; b < last_result_.band_times_ms.size(); b++) {
+                    ImGui::Text("  Band %d: %.2f ms", static_cast<int>(b), last_result_.band_times_ms[b]);
+                }
+                ImGui::Text(" SIMD path: %s", vision_pipeline_->getPerformanceStats().simd_path.c_str());
                 
                 if (last_result_.total_time_ms < 10.0) {
                     ImGui::TextColored(ImVec4(0, 1, 0, 1), "Target <10ms: MET ✓");
@@ -1608,6 +1631,27 @@ private:
             for (const auto& vec : s_values) all_s.insert(all_s.end(), vec.begin(), vec.end());
             for (const auto& vec : v_values) all_v.insert(all_v.end(), vec.begin(), vec.end());
             
+            // Hue is circular (179 sits next to 0). Rotate the samples so the
+            // widest near-empty stretch of the circle lands on the 0/180 cut;
+            // reddish products then get one range, wrapping if it crosses 0.
+            int hue_hist[180] = {0};
+            for (double h : all_h) hue_hist[std::min(179, (int)h)]++;
+            auto hue_bin_empty = [&](int bin) {
+                return static_cast<size_t>(hue_hist[(bin + 180) % 180]) * 1000 <= all_h.size();
+            };
+            int hue_shift = 0;
+            int widest_gap = 0;
+            for (int bin = 0; bin < 180; bin++) {
+                if (hue_bin_empty(bin) || !hue_bin_empty(bin - 1)) continue;
+                int gap = 0;
+                while (gap < 180 && hue_bin_empty(bin - 1 - gap)) gap++;
+                if (gap > widest_gap) {
+                    widest_gap = gap;
+                    hue_shift = bin;
+                }
+            }
+            for (double& h : all_h) h = std::fmod(h - hue_shift + 180.0, 180.0);
+            
             // Sort for percentile calculation
             std::sort(all_h.begin(), all_h.end());
             std::sort(all_s.begin(), all_s.end());
@@ -1626,7 +1670,8 @@ private:
             double v_lower = percentile(all_v, 0.10);
             double v_upper = percentile(all_v, 0.90);
             
-            std::cout << "  Raw percentile ranges - H:[" << h_lower << "-" << h_upper 
+            std::cout << "  Raw percentile ranges - H:[" << std::fmod(h_lower + hue_shift, 180.0)
+                      << "-" << std::fmod(h_upper + hue_shift, 180.0)
                       << "] S:[" << s_lower << "-" << s_upper 
                       << "] V:[" << v_lower << "-" << v_upper << "]" << std::endl;
             
@@ -1636,8 +1681,15 @@ private:
             double v_tol = 60.0;
             
             cv::Scalar lower, upper;
-            lower[0] = std::max(0.0, h_lower - h_tol);
-            upper[0] = std::min(180.0, h_upper + h_tol);
+            if (h_upper - h_lower + 2 * h_tol >= 179.0) {
+                // Tolerance covers the whole hue circle
+                lower[0] = 0.0;
+                upper[0] = 180.0;
+            } else {
+                // Back to real hues; lower > upper means the range wraps
+                lower[0] = std::fmod(h_lower - h_tol + hue_shift + 180.0, 180.0);
+                upper[0] = std::fmod(h_upper + h_tol + hue_shift, 180.0);
+            }
             lower[1] = std::max(0.0, s_lower - s_tol);
             upper[1] = std::min(255.0, s_upper + s_tol);
             lower[2] = std::max(0.0, v_lower - v_tol);
@@ -1676,7 +1728,8 @@ private:
             std::cout << "Polygons analyzed: " << h_values.size() << std::endl;
             std::cout << "Total pixels sampled: " << all_h.size() << std::endl;
             std::cout << "\nHSV Ranges (5th-95th percentile + margin):" << std::endl;
-            std::cout << "  Hue:        " << lower[0] << " - " << upper[0] << " (0-180)" << std::endl;
+            std::cout << "  Hue:        " << lower[0] << " - " << upper[0] << " (0-180)"
+                      << (lower[0] > upper[0] ? " wraps through 0" : "") << std::endl;
             std::cout << "  Saturation: " << lower[1] << " - " << upper[1] << " (0-255)" << std::endl;
             std::cout << "  Value:      " << lower[2] << " - " << upper[2] << " (0-255)" << std::endl;
             std::cout << "\nArea Range: " << (int)min_area << " - " << (int)max_area << " pixels" << std::endl;
@@ -1713,7 +1766,7 @@ private:
         }
         
         try {
-            last_result_ = vision_pipeline_->processFrame(current_image_);
+            vision_pipeline_->processFrame(current_image_, last_result_);
         } catch (const std::exception& e) {
             std::cerr << "Error in processFrame: " << e.what() << std::endl;
             return;
@@ -1753,7 +1806,7 @@ private:
         for (size_t i = 0; i < last_result_.contours.size(); i++) {
             // Safety check
             if (last_result_.contours[i].empty()) continue;
-            if (i >= last_result_.bounding_boxes.size()) continue;
+            if (i >= last_result_.measurements.size()) continue;
             
             // ROI-aware drawing: only show overlays inside ROI if enabled
             cv::Rect active_roi = vision_pipeline_->getROI();
@@ -1765,12 +1818,12 @@ private:
                     if (roi_enabled) {
                         // Draw contour to overlay then blend only within ROI
                         cv::Mat overlay = cv::Mat::zeros(result_image_.size(), result_image_.type());
-                        cv::drawContours(overlay, last_result_.contours, static_cast<int>(i), cv::Scalar(0, 255, 0), 2);
+                        drawContour(overlay, last_result_.contours[i], cv::Scalar(0, 255, 0), 2);
                         cv::Mat dst_roi = result_image_(active_roi);
                         cv::Mat overlay_roi = overlay(active_roi);
                         cv::addWeighted(dst_roi, 1.0, overlay_roi, 1.0, 0.0, dst_roi);
                     } else {
-                        cv::drawContours(result_image_, last_result_.contours, static_cast<int>(i), cv::Scalar(0, 255, 0), 2);
+                        drawContour(result_image_, last_result_.contours[i], cv::Scalar(0, 255, 0), 2);
                     }
                 } catch (...) {
                     std::cerr << "Error drawing contour " << i << std::endl;
@@ -1780,7 +1833,7 @@ private:
             // Draw bounding box (green if area passes, red if fails) if enabled - thick and prominent
             if (show_bounding_boxes_) {
                 try {
-                    cv::Rect bbox = last_result_.bounding_boxes[i];
+                    cv::Rect bbox = last_result_.measurements[i].bbox;
                     
                     // Determine box color based on area threshold (if enabled)
                     cv::Scalar box_color = cv::Scalar(0, 0, 255); // Default: red
@@ -1824,9 +1877,9 @@ private:
             }
             
             // Draw center point (yellow)
-            if (i < last_result_.centers.size()) {
+            if (i < last_result_.measurements.size()) {
                 try {
-                    const cv::Point2f& c = last_result_.centers[i];
+                    const cv::Point2f& c = last_result_.measurements[i].center;
                     if (!roi_enabled || active_roi.contains(c)) {
                         cv::circle(result_image_, c, 8, cv::Scalar(0, 255, 255), -1);
                         cv::circle(result_image_, c, 9, cv::Scalar(255, 255, 255), 2);
@@ -1839,7 +1892,7 @@ private:
             // Draw label with detection number and dimensions (only if bounding boxes are shown)
             if (show_bounding_boxes_ && i < last_result_.measurements.size()) {
                 try {
-                    cv::Rect bbox = last_result_.bounding_boxes[i];
+                    cv::Rect bbox = last_result_.measurements[i].bbox;
                     if (roi_enabled) {
                         bbox = bbox & active_roi;
                         if (bbox.area() <= 0) continue;
@@ -2026,8 +2079,7 @@ private:
                 recipe.detection_rules.max_area = 50000;
                 recipe.detection_rules.min_circularity = 0.3;
                 recipe.detection_rules.max_circularity = 1.0;
-                recipe.hsv_lower = cv::Scalar(20, 50, 50);
-                recipe.hsv_upper = cv::Scalar(40, 255, 255);
+                recipe.hsv_ranges = {{cv::Scalar(20, 50, 50), cv::Scalar(40, 255, 255)}};
                 
                 if (recipe_manager_->createRecipe(recipe)) {
                     refreshRecipeList();
@@ -2139,25 +2191,42 @@ private:
             ImGui::Separator();
             ImGui::Spacing();
             
-            // HSV Color Range
-            if (ImGui::CollapsingHeader("HSV Color Range", ImGuiTreeNodeFlags_DefaultOpen)) {
-                ImGui::Text("Lower HSV (H, S, V):");
-                float hsv_lower[3] = {
-                    static_cast<float>(edited_recipe_.hsv_lower[0]), 
-                    static_cast<float>(edited_recipe_.hsv_lower[1]), 
-                    static_cast<float>(edited_recipe_.hsv_lower[2])
-                };
-                if (ImGui::InputFloat3("##hsv_lower", hsv_lower)) {
-                    edited_recipe_.hsv_lower = cv::Scalar(hsv_lower[0], hsv_lower[1], hsv_lower[2]);
-                }
-                ImGui::Text("Upper HSV (H, S, V):");
-                float hsv_upper[3] = {
-                    static_cast<float>(edited_recipe_.hsv_upper[0]), 
-                    static_cast<float>(edited_recipe_.hsv_upper[1]), 
-                    static_cast<float>(edited_recipe_.hsv_upper[2])
-                };
-                if (ImGui::InputFloat3("##hsv_upper", hsv_upper)) {
-                    edited_recipe_.hsv_upper = cv::Scalar(hsv_upper[0], hsv_upper[1], hsv_upper[2]);
+            // HSV Color Ranges (union of boxes)
+            if (ImGui::CollapsingHeader("HSV Color Ranges", ImGuiTreeNodeFlags_DefaultOpen)) {
+                ImGui::TextDisabled("Hue lower > upper wraps through 0/180");
+                int remove_index = -1;
+                for (size_t i = 0; i < edited_recipe_.hsv_ranges.size(); i++) {
+                    HsvRange& range = edited_recipe_.hsv_ranges[i];
+                    ImGui::PushID(static_cast<int>(i));
+                    ImGui::Text("Box %zu Lower HSV (H, S, V):", i + 1);
+                    float hsv_lower[3] = {
+                        static_cast<float>(range.lower[0]), 
+                        static_cast<float>(range.lower[1]), 
+                        static_cast<float>(range.lower[2])
+                    };
+                    if (ImGui::InputFloat3("##hsv_lower", hsv_lower)) {
+                        range.lower = cv::Scalar(hsv_lower[0], hsv_lower[1], hsv_lower[2]);
+                    }
+                    ImGui::Text("Box %zu Upper HSV (H, S, V):", i + 1);
+                    float hsv_upper[3] = {
+                        static_cast<float>(range.upper[0]), 
+                        static_cast<float>(range.upper[1]), 
+                        static_cast<float>(range.upper[2])
+                    };
+                    if (ImGui::InputFloat3("##hsv_upper", hsv_upper)) {
+                        range.upper = cv::Scalar(hsv_upper[0], hsv_upper[1], hsv_upper[2]);
+                    }
+                    if (edited_recipe_.hsv_ranges.size() > 1 && ImGui::Button("Remove Box")) {
+                        remove_index = static_cast<int>(i);
+                    }
+                    ImGui::PopID();
+                }
+                if (remove_index >= 0) {
+                    edited_recipe_.hsv_ranges.erase(edited_recipe_.hsv_ranges.begin() + remove_index);
+                }
+                if (edited_recipe_.hsv_ranges.size() < static_cast<size_t>(kMaxColorBoxes) &&
+                    ImGui::Button("Add Box")) {
+                    edited_recipe_.hsv_ranges.push_back({cv::Scalar(20, 50, 50), cv::Scalar(40, 255, 255)});
                 }
                 ImGui::Spacing();
             }
@@ -2296,6 +2365,13 @@ private:
                 if (edited_recipe_.morph_kernel_size < 1) edited_recipe_.morph_kernel_size = 1;
                 if (edited_recipe_.morph_kernel_size % 2 == 0) edited_recipe_.morph_kernel_size++;
                 ImGui::Checkbox("Enable Preprocessing", &edited_recipe_.enable_preprocessing);
+                ImGui::Checkbox("Component Area Cleaning", &edited_recipe_.use_component_filter);
+                if (edited_recipe_.use_component_filter) {
+                    ImGui::InputInt("Min Component Area (px)", &edited_recipe_.min_component_area);
+                    ImGui::InputInt("Max Hole Area (px)", &edited_recipe_.max_hole_area);
+                    if (edited_recipe_.min_component_area < 0) edited_recipe_.min_component_area = 0;
+                    if (edited_recipe_.max_hole_area < 0) edited_recipe_.max_hole_area = 0;
+                }
                 ImGui::Spacing();
             }
             
@@ -2312,8 +2388,11 @@ private:
             ImGui::Spacing();
             
             if (ImGui::CollapsingHeader("HSV Range", ImGuiTreeNodeFlags_DefaultOpen)) {
-                ImGui::Text("  Lower: [%.0f, %.0f, %.0f]", recipe.hsv_lower[0], recipe.hsv_lower[1], recipe.hsv_lower[2]);
-                ImGui::Text("  Upper: [%.0f, %.0f, %.0f]", recipe.hsv_upper[0], recipe.hsv_upper[1], recipe.hsv_upper[2]);
+                for (size_t i = 0; i < recipe.hsv_ranges.size(); i++) {
+                    const HsvRange& range = recipe.hsv_ranges[i];
+                    ImGui::Text("  Box %zu Lower: [%.0f, %.0f, %.0f]", i + 1, range.lower[0], range.lower[1], range.lower[2]);
+                    ImGui::Text("  Box %zu Upper: [%.0f, %.0f, %.0f]", i + 1, range.upper[0], range.upper[1], range.upper[2]);
+                }
             }
             
             if (ImGui::CollapsingHeader("Detection Rules", ImGuiTreeNodeFlags_DefaultOpen)) {
@@ -417,7 +417,7 @@ private:
         vision_pipeline_->updateDetectionRules(rules);
         
         // Run detection
-        last_result_ = vision_pipeline_->processFrame(current_image_);
+        vision_pipeline_->processFrame(current_image_, last_result_);
         
         // Draw results
         result_image_ = current_image_.clone();
@@ -0,0 +1,198 @@
+#include "belt_stitcher.h"
+#include <algorithm>
+#include <cmath>
+
+namespace country_style {
+
+namespace {
+
+// Every 8th pixel of a row goes into its profile value
+const int kProfileStep = 8;
+
+// Phase correlation peaks below this are not trusted (belt without texture)
+const double kMinResponse = 0.05;
+
+// Pieces still unfinished after this many area heights of belt are cut off
+const int kMaxMosaicAreas = 4;
+
+} // namespace
+
+BeltStitcher::BeltStitcher()
+    : direction_(1), started_(false), carry_(0.0), last_shift_(0.0), head_cut_(true),
+      head_counted_(false) {}
+
+void BeltStitcher::setDirection(int direction) {
+    direction_ = direction < 0 ? -1 : 1;
+    reset();
+}
+
+void BeltStitcher::reset() {
+    started_ = false;
+    carry_ = 0.0;
+    last_shift_ = 0.0;
+    mosaic_.reset(cv::Rect());
+    head_cut_ = true;
+    head_counted_ = false;
+}
+
+void BeltStitcher::rowProfile(const cv::Mat& frame, const cv::Rect& area) {
+    profile_.create(1, area.height, CV_32F);
+    float* profile = profile_.ptr<float>();
+    double mean = 0.0;
+    for (int y = 0; y < area.height; y++) {
+        const uint8_t* row = frame.ptr<uint8_t>(area.y + y) + area.x * 3;
+        int sum = 0;
+        for (int x = 0; x < area.width; x += kProfileStep) {
+            sum += row[x * 3] + row[x * 3 + 1] + row[x * 3 + 2];
+        }
+        profile[y] = static_cast<float>(sum);
+        mean += sum;
+    }
+    
+    mean /= area.height;
+    for (int y = 0; y < area.height; y++) {
+        profile[y] -= static_cast<float>(mean);
+    }
+    
+    // Hann window so the ends of the area do not dominate the correlation
+    if (window_.cols != area.height) {
+        window_.create(1, area.height, CV_32F);
+        float* window = window_.ptr<float>();
+        for (int y = 0; y < area.height; y++) {
+            window[y] = area.height > 1
+                ? static_cast<float>(0.5 - 0.5 * std::cos(2.0 * CV_PI * y / (area.height - 1)))
+                : 1.0f;
+        }
+    }
+}
+
+int BeltStitcher::advance(const cv::Mat& frame, const cv::Rect& area) {
+    if (area.width <= 0 || area.height <= 0) {
+        return 0;
+    }
+    
+    if (!started_ || area != area_) {
+        reset();
+        started_ = true;
+        area_ = area;
+        mosaic_.reset(cv::Rect(0, 0, area.width, 0));
+        rowProfile(frame, area);
+        std::swap(profile_, previous_profile_);
+        return area.height;
+    }
+    
+    // Positive phase shift: the profile moved towards higher rows
+    rowProfile(frame, area);
+    double response = 0.0;
+    const cv::Point2d shift = cv::phaseCorrelate(previous_profile_, profile_, window_, &response);
+    std::swap(profile_, previous_profile_);
+    
+    // An empty belt gives no usable peak; it is taken to keep its speed
+    double rows = response >= kMinResponse ? shift.x * direction_ : last_shift_;
+    rows = std::max(0.0, rows);
+    last_shift_ = rows;
+    
+    carry_ += rows;
+    const int exposed = static_cast<int>(std::floor(carry_));
+    carry_ -= exposed;
+    return std::min(exposed, area.height);
+}
+
+void BeltStitcher::append(const RleMask& strip, int rows) {
+    rows = std::min(rows, strip.bounds.height);
+    for (int k = 0; k < rows; k++) {
+        // Oldest of the new rows first: the one furthest from the incoming
+        // edge
+        const int y = direction_ > 0 ? rows - 1 - k : strip.bounds.height - rows + k;
+        mosaic_.runs.insert(mosaic_.runs.end(), strip.runs.begin() + strip.rowBegin(y),
+                            strip.runs.begin() + strip.rowEnd(y));
+        mosaic_.row_offsets.push_back(static_cast<int>(mosaic_.runs.size()));
+    }
+    mosaic_.bounds.height += std::max(0, rows);
+}
+
+int BeltStitcher::takeComplete(const cv::Rect& area, RleMask& pieces) {
+    pieces.reset(cv::Rect());
+    const int rows = mosaic_.bounds.height;
+    if (rows == 0) {
+        return 0;
+    }
+    
+    // A piece is whole once the newest row does not reach it. Pieces that
+    // started before the first row seen are only partly in the mosaic, and
+    // so are pieces still reaching the newest row when the mosaic grows too
+    // long: they are cut there and the rest of them is dropped later.
+    const std::vector<BlobStats>& blobs = labeler_.label(mosaic_);
+    const bool overflow = rows > kMaxMosaicAreas * area.height;
+    complete_.assign(blobs.size(), 0);
+    int first = rows;
+    int last = -1;
+    int dropped = 0;
+    bool cut = false;
+    for (size_t b = 0; b < blobs.size(); b++) {
+        const cv::Rect& box = blobs[b].bbox;
+        const bool growing = box.y + box.height == rows;
+        if (growing && !overflow) {
+            continue;
+        }
+        const bool head = head_cut_ && box.y == 0;
+        if (head || growing) {
+            // A head already counted when it was cut is not counted again
+            complete_[b] = 2;
+            if (!head || !head_counted_) dropped++;
+            cut = cut || growing;
+            continue;
+        }
+        complete_[b] = 1;
+        first = std::min(first, box.y);
+        last = std::max(last, box.y + box.height - 1);
+    }
+    
+    // Whole pieces in frame orientation: the newest mosaic row lies on the
+    // area's incoming edge
+    const int newest = rows - 1;
+    if (last >= 0) {
+        const int height = last - first + 1;
+        const int top = direction_ > 0 ? area.y + (newest - last)
+                                       : area.y + area.height - 1 - (newest - first);
+        pieces.reset(cv::Rect(area.x, top, area.width, height));
+        for (int y = 0; y < height; y++) {
+            const int r = direction_ > 0 ? last - y : first + y;
+            pieces.row_offsets[y] = static_cast<int>(pieces.runs.size());
+            for (int i = mosaic_.rowBegin(r); i < mosaic_.rowEnd(r); i++) {
+                if (complete_[labeler_.runBlob(i)] == 1) {
+                    pieces.runs.push_back(mosaic_.runs[i]);
+                }
+            }
+        }
+        pieces.row_offsets[height] = static_cast<int>(pieces.runs.size());
+    }
+    
+    // Keep the runs of unfinished pieces, from the first row holding one
+    int start = 0;
+    while (start < rows) {
+        bool pending = false;
+        for (int i = mosaic_.rowBegin(start); i < mosaic_.rowEnd(start) && !pending; i++) {
+            pending = complete_[labeler_.runBlob(i)] == 0;
+        }
+        if (pending) break;
+        start++;
+    }
+    
+    pending_.reset(cv::Rect(0, 0, mosaic_.bounds.width, rows - start));
+    for (int r = start; r < rows; r++) {
+        pending_.row_offsets[r - start] = static_cast<int>(pending_.runs.size());
+        for (int i = mosaic_.rowBegin(r); i < mosaic_.rowEnd(r); i++) {
+            if (complete_[labeler_.runBlob(i)] == 0) {
+                pending_.runs.push_back(mosaic_.runs[i]);
+            }
+        }
+    }
+    pending_.row_offsets[rows - start] = static_cast<int>(pending_.runs.size());
+    std::swap(mosaic_, pending_);
+    head_counted_ = cut || (head_counted_ && head_cut_ && start == 0);
+    head_cut_ = cut || (head_cut_ && start == 0);
+    return dropped;
+}
+
+} // namespace country_style
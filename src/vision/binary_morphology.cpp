@@ -0,0 +1,469 @@
+#include "binary_morphology.h"
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace country_style {
+
+namespace {
+
+// Bits x + s (k = 0..63) of the row around padded word wi, |s| < 64
+inline uint64_t shifted(const uint64_t* row, int wi, int s) {
+    if (s > 0) {
+        return (row[wi] >> s) | (row[wi + 1] << (64 - s));
+    }
+    if (s < 0) {
+        return (row[wi] << -s) | (row[wi - 1] >> (64 + s));
+    }
+    return row[wi];
+}
+
+template <bool Erode>
+inline uint64_t combine(uint64_t a, uint64_t b) {
+    return Erode ? (a & b) : (a | b);
+}
+
+#if !(defined(__SSE2__) || defined(_M_X64))
+// 8 mask bytes -> 8 bits (byte k -> bit k), any non-zero byte counts
+inline uint64_t packBytes(uint64_t v) {
+    const uint64_t low7 = 0x7F7F7F7F7F7F7F7FULL;
+    uint64_t nonzero = (((v & low7) + low7) | v) & ~low7;
+    return ((nonzero >> 7) * 0x0102040810204080ULL) >> 56;
+}
+#endif
+
+// Index of the lowest set bit of a non-zero word
+inline int lowestBit(uint64_t v) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, v);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
+// 8 bits -> 8 mask bytes of 0 or 255
+struct ExpandTable {
+    uint64_t bytes[256];
+    ExpandTable() {
+        for (int b = 0; b < 256; b++) {
+            uint64_t v = 0;
+            for (int k = 0; k < 8; k++) {
+                if (b & (1 << k)) v |= 0xFFULL << (8 * k);
+            }
+            bytes[b] = v;
+        }
+    }
+};
+
+const ExpandTable& expandTable() {
+    static const ExpandTable table;
+    return table;
+}
+
+} // namespace
+
+BinaryMorphology::BinaryMorphology()
+    : identity_(true), reach_rows_(0), width_(0), height_(0), words_(0), stride_(0), tail_(0) {}
+
+bool BinaryMorphology::setKernel(const cv::Mat& kernel) {
+    bands_.clear();
+    identity_ = false;
+    reach_rows_ = 0;
+    
+    if (kernel.empty() || kernel.type() != CV_8UC1 ||
+        kernel.cols > 63 || kernel.rows > 63) {
+        return false;
+    }
+    
+    // OpenCV copies the mask for a 1x1 element
+    if (kernel.rows * kernel.cols == 1) {
+        identity_ = true;
+        return true;
+    }
+    
+    const int ax = kernel.cols / 2;
+    const int ay = kernel.rows / 2;
+    
+    // One run per row, as offsets from the anchor
+    struct Row { int dy, lo, hi; };
+    std::vector<Row> rows;
+    int set_pixels = 0;
+    for (int i = 0; i < kernel.rows; i++) {
+        const uint8_t* k = kernel.ptr<uint8_t>(i);
+        int j = 0;
+        while (j < kernel.cols && !k[j]) j++;
+        if (j == kernel.cols) continue;
+        int begin = j;
+        while (j < kernel.cols && k[j]) j++;
+        int end = j;
+        while (j < kernel.cols && !k[j]) j++;
+        if (j < kernel.cols) {
+            return false;  // Several runs in one row
+        }
+        rows.push_back({i - ay, begin - ax, end - 1 - ax});
+        set_pixels += end - begin;
+    }
+    
+    // cv::morphologyEx turns iterations of a full rectangle into one pass
+    // with a larger rectangle, which pads differently
+    if (rows.empty() || set_pixels == kernel.rows * kernel.cols) {
+        return false;
+    }
+    
+    // Distinct runs, widest first. They must nest, and the rows whose run
+    // covers each of them must be contiguous; the element is then the union
+    // of one rectangle per distinct run and, since a wider run's result is
+    // contained in a narrower one's, each pass is the AND (erode) or OR
+    // (dilate) of the per-band results.
+    std::vector<Row> runs = rows;
+    std::sort(runs.begin(), runs.end(), [](const Row& a, const Row& b) {
+        return (a.hi - a.lo) > (b.hi - b.lo) || ((a.hi - a.lo) == (b.hi - b.lo) && a.lo < b.lo);
+    });
+    for (size_t r = 0; r < runs.size(); r++) {
+        if (r > 0 && runs[r].lo == runs[r - 1].lo && runs[r].hi == runs[r - 1].hi) {
+            continue;
+        }
+        if (r > 0 && (runs[r].lo < runs[r - 1].lo || runs[r].hi > runs[r - 1].hi)) {
+            return false;  // Rows do not nest
+        }
+        
+        Band band;
+        band.lo = runs[r].lo;
+        band.hi = runs[r].hi;
+        band.top = kernel.rows;
+        band.bottom = -kernel.rows;
+        int covering = 0;
+        for (const auto& row : rows) {
+            if (row.lo <= band.lo && row.hi >= band.hi) {
+                band.top = std::min(band.top, row.dy);
+                band.bottom = std::max(band.bottom, row.dy);
+                covering++;
+            }
+        }
+        if (covering != band.bottom - band.top + 1) {
+            return false;  // Covering rows have a gap
+        }
+        bands_.push_back(band);
+        reach_rows_ = std::max(reach_rows_, std::max(-band.top, band.bottom));
+    }
+    
+    return true;
+}
+
+void BinaryMorphology::openClose(cv::Mat& mask, int open_iterations, int close_iterations) {
+    if (mask.empty() || identity_ || bands_.empty()) {
+        return;
+    }
+    
+    pack(mask);
+    runPasses(open_iterations, close_iterations);
+    unpack(mask);
+}
+    
+void BinaryMorphology::openClose(RleMask& mask, int open_iterations, int close_iterations) {
+    if (mask.bounds.area() <= 0 || identity_ || bands_.empty()) {
+        return;
+    }
+    
+    packRuns(mask);
+    runPasses(open_iterations, close_iterations);
+    unpackRuns(mask);
+}
+
+void BinaryMorphology::runPasses(int open_iterations, int close_iterations) {
+    // OPEN: erode then dilate, CLOSE: dilate then erode, each repeated
+    for (int i = 0; i < open_iterations; i++) pass<true>();
+    for (int i = 0; i < open_iterations; i++) pass<false>();
+    for (int i = 0; i < close_iterations; i++) pass<false>();
+    for (int i = 0; i < close_iterations; i++) pass<true>();
+}
+
+void BinaryMorphology::resize(int width, int height) {
+    // Every word is rewritten before it is read, so buffers only grow; bands
+    // of different heights reuse the same storage
+    width_ = width;
+    height_ = height;
+    words_ = (width_ + 63) / 64;
+    stride_ = words_ + 2;
+    tail_ = (width_ % 64) ? ~0ULL << (width_ % 64) : 0;
+        
+    const size_t padded = static_cast<size_t>(height_) * stride_;
+    if (src_.size() < padded) {
+        src_.resize(padded);
+        dst_.resize(padded);
+    }
+    if (run_rows_.size() < static_cast<size_t>(height_) * words_) {
+        run_rows_.resize(static_cast<size_t>(height_) * words_);
+    }
+    if (run_buffer_.size() < static_cast<size_t>(stride_) + 1) {
+        run_buffer_.resize(stride_ + 1);
+    }
+    if (fill_row_.size() < static_cast<size_t>(words_)) {
+        fill_row_.resize(words_);
+    }
+}
+
+void BinaryMorphology::pack(const cv::Mat& mask) {
+    resize(mask.cols, mask.rows);
+    
+    for (int y = 0; y < height_; y++) {
+        const uint8_t* m = mask.ptr<uint8_t>(y);
+        uint64_t* row = &src_[static_cast<size_t>(y) * stride_ + 1];
+        
+        int x = 0;
+        for (int w = 0; w < words_; w++) {
+            uint64_t word = 0;
+            if (x + 64 <= width_) {
+#if defined(__SSE2__) || defined(_M_X64)
+                // SSE2 is part of x86-64, so no runtime dispatch is needed
+                const __m128i zero = _mm_setzero_si128();
+                for (int b = 0; b < 4; b++) {
+                    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m + x + b * 16));
+                    uint32_t is_zero = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)));
+                    word |= static_cast<uint64_t>(~is_zero & 0xFFFF) << (b * 16);
+                }
+#else
+                for (int b = 0; b < 8; b++) {
+                    uint64_t v;
+                    std::memcpy(&v, m + x + b * 8, 8);
+                    word |= packBytes(v) << (b * 8);
+                }
+#endif
+            } else {
+                for (int k = 0; x + k < width_; k++) {
+                    if (m[x + k]) word |= 1ULL << k;
+                }
+            }
+            row[w] = word;
+            x += 64;
+        }
+    }
+}
+
+void BinaryMorphology::unpack(cv::Mat& mask) const {
+    const ExpandTable& table = expandTable();
+    
+    for (int y = 0; y < height_; y++) {
+        uint8_t* m = mask.ptr<uint8_t>(y);
+        const uint64_t* row = &src_[static_cast<size_t>(y) * stride_ + 1];
+        
+        int x = 0;
+        for (int w = 0; w < words_; w++) {
+            uint64_t word = row[w];
+            if (x + 64 <= width_) {
+                for (int b = 0; b < 8; b++) {
+                    std::memcpy(m + x + b * 8, &table.bytes[(word >> (b * 8)) & 0xFF], 8);
+                }
+            } else {
+                for (int k = 0; x + k < width_; k++) {
+                    m[x + k] = (word >> k) & 1 ? 255 : 0;
+                }
+            }
+            x += 64;
+        }
+    }
+}
+
+void BinaryMorphology::packRuns(const RleMask& mask) {
+    resize(mask.bounds.width, mask.bounds.height);
+    
+    for (int y = 0; y < height_; y++) {
+        uint64_t* row = &src_[static_cast<size_t>(y) * stride_ + 1];
+        std::memset(row, 0, words_ * sizeof(uint64_t));
+        
+        for (int r = mask.rowBegin(y); r < mask.rowEnd(y); r++) {
+            const int begin = mask.runs[r][0];
+            const int last = mask.runs[r][1] - 1;
+            const uint64_t head = ~0ULL << (begin & 63);
+            const uint64_t tail = ~0ULL >> (63 - (last & 63));
+            const int first_word = begin >> 6;
+            const int last_word = last >> 6;
+            if (first_word == last_word) {
+                row[first_word] |= head & tail;
+            } else {
+                row[first_word] |= head;
+                for (int w = first_word + 1; w < last_word; w++) row[w] = ~0ULL;
+                row[last_word] |= tail;
+            }
+        }
+    }
+}
+
+void BinaryMorphology::unpackRuns(RleMask& mask) const {
+    mask.runs.clear();
+    for (int y = 0; y < height_; y++) {
+        mask.row_offsets[y] = static_cast<int>(mask.runs.size());
+        const uint64_t* row = &src_[static_cast<size_t>(y) * stride_ + 1];
+        
+        // Walk the bit transitions of each word; a run may span words
+        int start = -1;
+        for (int w = 0; w < words_; w++) {
+            const uint64_t word = (w == words_ - 1) ? (row[w] & ~tail_) : row[w];
+            int pos = 0;
+            while (pos < 64) {
+                if (start < 0) {
+                    const uint64_t set = word >> pos;
+                    if (!set) break;
+                    pos += lowestBit(set);
+                    start = w * 64 + pos;
+                } else {
+                    const uint64_t clear = ~word >> pos;
+                    if (!clear) break;
+                    pos += lowestBit(clear);
+                    mask.runs.push_back(cv::Vec2i(start, w * 64 + pos));
+                    start = -1;
+                }
+            }
+        }
+        if (start >= 0) {
+            mask.runs.push_back(cv::Vec2i(start, width_));
+        }
+    }
+    mask.row_offsets[height_] = static_cast<int>(mask.runs.size());
+}
+
+template <bool Erode>
+void BinaryMorphology::pass() {
+    // Pixels outside the mask count as set for erosion and clear for
+    // dilation, like morphologyDefaultBorderValue()
+    const uint64_t fill = Erode ? ~0ULL : 0;
+    for (int y = 0; y < height_; y++) {
+        uint64_t* row = &src_[static_cast<size_t>(y) * stride_];
+        row[0] = fill;
+        row[stride_ - 1] = fill;
+        row[words_] = Erode ? (row[words_] | tail_) : (row[words_] & ~tail_);
+    }
+    std::fill(fill_row_.begin(), fill_row_.end(), fill);
+    
+    for (size_t b = 0; b < bands_.size(); b++) {
+        const Band& band = bands_[b];
+        if (band.lo == 0 && band.hi == 0) {
+            // Single column: the band reads the packed rows directly
+            applyColumn<Erode>(band, &src_[1], stride_, b == 0);
+            continue;
+        }
+        for (int y = 0; y < height_; y++) {
+            applyRun<Erode>(&src_[static_cast<size_t>(y) * stride_],
+                            &run_rows_[static_cast<size_t>(y) * words_], band.lo, band.hi);
+        }
+        applyColumn<Erode>(band, run_rows_.data(), words_, b == 0);
+    }
+    
+    std::swap(src_, dst_);
+}
+
+template <bool Erode>
+void BinaryMorphology::applyRun(const uint64_t* row, uint64_t* out, int lo, int hi) {
+    const int length = hi - lo + 1;
+    
+    if (length <= 3) {
+        for (int w = 0; w < words_; w++) {
+            uint64_t v = shifted(row, w + 1, lo);
+            for (int s = lo + 1; s <= hi; s++) {
+                v = combine<Erode>(v, shifted(row, w + 1, s));
+            }
+            out[w] = v;
+        }
+        return;
+    }
+    
+    // Log-step doubling: a[x] covers [x, x + p) after each step, then two
+    // overlapping windows of p cover [x, x + length)
+    uint64_t* a = run_buffer_.data();
+    std::memcpy(a, row, stride_ * sizeof(uint64_t));
+    a[stride_] = Erode ? ~0ULL : 0;
+    
+    int p = 1;
+    while (p * 2 <= length) {
+        for (int w = 0; w < stride_; w++) {
+            a[w] = combine<Erode>(a[w], shifted(a, w, p));
+        }
+        p *= 2;
+    }
+    
+    for (int w = 0; w < words_; w++) {
+        out[w] = combine<Erode>(shifted(a, w + 1, lo), shifted(a, w + 1, lo + length - p));
+    }
+}
+
+template <bool Erode>
+void BinaryMorphology::applyColumn(const Band& band, const uint64_t* rows, int row_stride, bool first) {
+    const int length = band.bottom - band.top + 1;
+    
+    // Row u of the band's input is mask row u + top; rows outside are fill
+    auto input = [&](int u) -> const uint64_t* {
+        int y = u + band.top;
+        return (y >= 0 && y < height_) ? rows + static_cast<size_t>(y) * row_stride : fill_row_.data();
+    };
+    auto output = [&](int y) -> uint64_t* {
+        return &dst_[static_cast<size_t>(y) * stride_ + 1];
+    };
+    
+    if (length <= 5) {
+        const uint64_t* in[5];
+        for (int y = 0; y < height_; y++) {
+            for (int t = 0; t < length; t++) {
+                in[t] = input(y + t);
+            }
+            uint64_t* out = output(y);
+            for (int w = 0; w < words_; w++) {
+                uint64_t v = in[0][w];
+                for (int t = 1; t < length; t++) {
+                    v = combine<Erode>(v, in[t][w]);
+                }
+                out[w] = first ? v : combine<Erode>(out[w], v);
+            }
+        }
+        return;
+    }
+    
+    // van Herk/Gil-Werman: split the input into blocks of length rows; a
+    // window starting at u is suffix[u] combined with prefix[u + length - 1],
+    // three word operations per output word whatever the band height
+    const int count = height_ + length - 1;
+    prefix_.resize(static_cast<size_t>(count) * words_);
+    suffix_.resize(static_cast<size_t>(count) * words_);
+    
+    for (int start = 0; start < count; start += length) {
+        const int end = std::min(start + length, count);
+        for (int u = start; u < end; u++) {
+            uint64_t* p = &prefix_[static_cast<size_t>(u) * words_];
+            const uint64_t* in = input(u);
+            if (u == start) {
+                std::memcpy(p, in, words_ * sizeof(uint64_t));
+            } else {
+                const uint64_t* prev = p - words_;
+                for (int w = 0; w < words_; w++) p[w] = combine<Erode>(prev[w], in[w]);
+            }
+        }
+        for (int u = end - 1; u >= start; u--) {
+            uint64_t* s = &suffix_[static_cast<size_t>(u) * words_];
+            const uint64_t* in = input(u);
+            if (u == end - 1) {
+                std::memcpy(s, in, words_ * sizeof(uint64_t));
+            } else {
+                const uint64_t* next = s + words_;
+                for (int w = 0; w < words_; w++) s[w] = combine<Erode>(next[w], in[w]);
+            }
+        }
+    }
+    
+    for (int y = 0; y < height_; y++) {
+        uint64_t* out = output(y);
+        const uint64_t* s = &suffix_[static_cast<size_t>(y) * words_];
+        const uint64_t* p = &prefix_[static_cast<size_t>(y + length - 1) * words_];
+        for (int w = 0; w < words_; w++) {
+            uint64_t v = combine<Erode>(s[w], p[w]);
+            out[w] = first ? v : combine<Erode>(out[w], v);
+        }
+    }
+}
+
+} // namespace country_style
@@ -0,0 +1,310 @@
+#include "blob_labeler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace country_style {
+
+namespace {
+
+const double kSqrt2 = 1.4142135623730951;
+
+// Runs of consecutive rows touch, diagonals included
+inline bool touches(const cv::Vec2i& a, const cv::Vec2i& b) {
+    return a[0] <= b[1] && b[0] <= a[1];
+}
+
+// Contour length between the ends of touching runs of consecutive rows
+// that are dx apart: one vertical step, or a diagonal plus |dx| - 1
+// horizontal steps
+inline double stepLength(int dx) {
+    return dx == 0 ? 1.0 : (std::abs(dx) - 1) + kSqrt2;
+}
+
+// Contour length around the concave gap between pixel a and pixel b of one
+// row, bridged by a run of the neighbouring row: down, across, back up
+inline double gapLength(int a, int b) {
+    return (b - a - 2) + 2.0 * kSqrt2;
+}
+
+} // namespace
+
+BlobLabeler::BlobLabeler() {}
+
+int BlobLabeler::newLabel(const cv::Vec2i& run, int y) {
+    int label = static_cast<int>(parent_.size());
+    parent_.push_back(label);
+    area_.push_back(0);
+    sum_x_.push_back(0);
+    sum_y_.push_back(0);
+    bounds_.push_back(cv::Vec4i(run[0], y, run[1] - 1, y));
+    perimeter_.push_back(0.0);
+    addRun(label, run, y);
+    return label;
+}
+
+int BlobLabeler::findRoot(int label) {
+    while (parent_[label] != label) {
+        parent_[label] = parent_[parent_[label]];
+        label = parent_[label];
+    }
+    return label;
+}
+
+int BlobLabeler::merge(int a, int b) {
+    a = findRoot(a);
+    b = findRoot(b);
+    if (a == b) return a;
+    
+    // The older label stays the root, so parents precede their children
+    if (a > b) std::swap(a, b);
+    parent_[b] = a;
+    area_[a] += area_[b];
+    sum_x_[a] += sum_x_[b];
+    sum_y_[a] += sum_y_[b];
+    bounds_[a][0] = std::min(bounds_[a][0], bounds_[b][0]);
+    bounds_[a][1] = std::min(bounds_[a][1], bounds_[b][1]);
+    bounds_[a][2] = std::max(bounds_[a][2], bounds_[b][2]);
+    bounds_[a][3] = std::max(bounds_[a][3], bounds_[b][3]);
+    perimeter_[a] += perimeter_[b];
+    return a;
+}
+
+void BlobLabeler::addRun(int root, const cv::Vec2i& run, int y) {
+    const int length = run[1] - run[0];
+    area_[root] += length;
+    sum_x_[root] += static_cast<int64_t>(run[0] + run[1] - 1) * length / 2;
+    sum_y_[root] += static_cast<int64_t>(y) * length;
+    bounds_[root][0] = std::min(bounds_[root][0], run[0]);
+    bounds_[root][2] = std::max(bounds_[root][2], run[1] - 1);
+    bounds_[root][3] = std::max(bounds_[root][3], y);
+}
+
+void BlobLabeler::addPerimeter(size_t prev_begin, size_t prev_end,
+                               size_t row_begin, size_t row_end) {
+    // Runs of this row: top edge if nothing touches them from above,
+    // otherwise the left and right contour steps down from the outermost
+    // runs above, plus the gaps between runs above that they merge. A step
+    // is skipped when the run above splits, as the gap below covers it.
+    size_t k = prev_begin;
+    for (size_t j = row_begin; j < row_end; j++) {
+        const cv::Vec2i& run = runs_[j];
+        while (k < prev_end && runs_[k][1] < run[0]) k++;
+        
+        double length = 0.0;
+        if (k >= prev_end || runs_[k][0] > run[1]) {
+            length = run[1] - run[0] - 1;
+        } else {
+            size_t last = k;
+            while (last + 1 < prev_end && runs_[last + 1][0] <= run[1]) {
+                length += gapLength(runs_[last][1] - 1, runs_[last + 1][0]);
+                last++;
+            }
+            if (j == row_begin || !touches(runs_[k], runs_[j - 1])) {
+                length += stepLength(run[0] - runs_[k][0]);
+            }
+            if (j + 1 == row_end || !touches(runs_[last], runs_[j + 1])) {
+                length += stepLength(run[1] - runs_[last][1]);
+            }
+        }
+        perimeter_[findRoot(run_labels_[j])] += length;
+    }
+    
+    // Runs of the previous row: bottom edge if nothing touches them from
+    // below, otherwise the gaps between the runs they split into
+    k = row_begin;
+    for (size_t j = prev_begin; j < prev_end; j++) {
+        const cv::Vec2i& run = runs_[j];
+        while (k < row_end && runs_[k][1] < run[0]) k++;
+        
+        double length = 0.0;
+        if (k >= row_end || runs_[k][0] > run[1]) {
+            length = run[1] - run[0] - 1;
+        } else {
+            for (size_t next = k + 1; next < row_end && runs_[next][0] <= run[1]; next++) {
+                length += gapLength(runs_[next - 1][1] - 1, runs_[next][0]);
+            }
+        }
+        perimeter_[findRoot(run_labels_[j])] += length;
+    }
+}
+
+void BlobLabeler::clear(const cv::Point& offset) {
+    runs_.clear();
+    run_labels_.clear();
+    row_offsets_.clear();
+    parent_.clear();
+    area_.clear();
+    sum_x_.clear();
+    sum_y_.clear();
+    bounds_.clear();
+    perimeter_.clear();
+    blobs_.clear();
+    offset_ = offset;
+}
+    
+void BlobLabeler::joinRow(int y, size_t prev_begin, size_t prev_end) {
+    const size_t row_begin = row_offsets_.back();
+    run_labels_.resize(runs_.size());
+    
+    // Join every run above that touches each run of this row
+    size_t k = prev_begin;
+    for (size_t j = row_begin; j < runs_.size(); j++) {
+        const cv::Vec2i& run = runs_[j];
+        while (k < prev_end && runs_[k][1] < run[0]) k++;
+        int label = -1;
+        for (size_t m = k; m < prev_end && runs_[m][0] <= run[1]; m++) {
+            label = (label < 0) ? findRoot(run_labels_[m]) : merge(label, run_labels_[m]);
+        }
+            
+        if (label < 0) {
+            label = newLabel(run, y);
+        } else {
+            addRun(label, run, y);
+        }
+        run_labels_[j] = label;
+    }
+        
+    addPerimeter(prev_begin, prev_end, row_begin, runs_.size());
+}
+
+const std::vector<BlobStats>& BlobLabeler::label(const RleMask& mask) {
+    clear(mask.bounds.tl());
+    
+    size_t prev_begin = 0;
+    size_t prev_end = 0;
+    for (int y = 0; y < mask.bounds.height; y++) {
+        row_offsets_.push_back(static_cast<int>(runs_.size()));
+        runs_.insert(runs_.end(), mask.runs.begin() + mask.rowBegin(y),
+                     mask.runs.begin() + mask.rowEnd(y));
+        joinRow(y, prev_begin, prev_end);
+        prev_begin = row_offsets_.back();
+        prev_end = runs_.size();
+    }
+    finish(prev_begin, prev_end);
+    return blobs_;
+}
+
+void BlobLabeler::finish(size_t prev_begin, size_t prev_end) {
+    row_offsets_.push_back(static_cast<int>(runs_.size()));
+    
+    // Bottom edges of the last row
+    addPerimeter(prev_begin, prev_end, prev_end, prev_end);
+    
+    // One blob per root, in order of first pixel
+    const size_t label_count = parent_.size();
+    blob_of_label_.resize(label_count);
+    for (size_t l = 0; l < label_count; l++) {
+        if (parent_[l] != static_cast<int>(l)) {
+            parent_[l] = parent_[parent_[l]];
+            blob_of_label_[l] = blob_of_label_[parent_[l]];
+            continue;
+        }
+        
+        blob_of_label_[l] = static_cast<int>(blobs_.size());
+        const cv::Vec4i& b = bounds_[l];
+        BlobStats blob;
+        blob.area = area_[l];
+        blob.bbox = cv::Rect(b[0] + offset_.x, b[1] + offset_.y, b[2] - b[0] + 1, b[3] - b[1] + 1);
+        blob.centroid = cv::Point2f(
+            static_cast<float>(static_cast<double>(sum_x_[l]) / area_[l] + offset_.x),
+            static_cast<float>(static_cast<double>(sum_y_[l]) / area_[l] + offset_.y));
+        blob.perimeter = perimeter_[l];
+        blobs_.push_back(blob);
+    }
+}
+
+cv::Mat BlobLabeler::drawBlob(int blob) {
+    const cv::Rect bbox = blobs_[blob].bbox - offset_;
+    if (trace_buffer_.rows < bbox.height + 2 || trace_buffer_.cols < bbox.width + 2) {
+        // Doubled when too small, so a few slightly larger blobs later do
+        // not each reallocate it
+        const int rows = trace_buffer_.rows < bbox.height + 2
+                             ? std::max(trace_buffer_.rows * 2, bbox.height + 2)
+                             : trace_buffer_.rows;
+        const int cols = trace_buffer_.cols < bbox.width + 2
+                             ? std::max(trace_buffer_.cols * 2, bbox.width + 2)
+                             : trace_buffer_.cols;
+        trace_buffer_.create(rows, cols, CV_8UC1);
+    }
+    cv::Mat view = trace_buffer_(cv::Rect(0, 0, bbox.width + 2, bbox.height + 2));
+    view.setTo(0);
+    
+    // Redraw just this blob's runs
+    for (int y = bbox.y; y < bbox.y + bbox.height; y++) {
+        uint8_t* row = view.ptr<uint8_t>(y - bbox.y + 1);
+        for (int r = row_offsets_[y]; r < row_offsets_[y + 1]; r++) {
+            const cv::Vec2i& run = runs_[r];
+            if (blob_of_label_[run_labels_[r]] == blob) {
+                std::memset(row + run[0] - bbox.x + 1, 255, run[1] - run[0]);
+            }
+        }
+    }
+    return view;
+}
+
+void BlobLabeler::traceContour(int blob, ContourArena& arena) {
+    arena.beginContour();
+    if (blob < 0 || blob >= static_cast<int>(blobs_.size())) {
+        return;
+    }
+    
+    const cv::Mat view = drawBlob(blob);
+    const cv::Rect bbox = blobs_[blob].bbox - offset_;
+    
+    // Chain code directions, counterclockwise from east, and their offsets
+    // in the buffer (repeated so a search can run past 7)
+    static const int kDx[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+    static const int kDy[8] = {0, -1, -1, -1, 0, 1, 1, 1};
+    const int step = static_cast<int>(view.step);
+    int deltas[16];
+    for (int s = 0; s < 8; s++) {
+        deltas[s] = deltas[s + 8] = kDy[s] * step + kDx[s];
+    }
+    
+    // The border starts at the blob's first pixel in raster order, which
+    // lies in its top row
+    const uint8_t* top = view.ptr<uint8_t>(1);
+    int x0 = 1;
+    while (top[x0] == 0) x0++;
+    const uint8_t* i0 = top + x0;
+    cv::Point point = offset_ + bbox.tl() + cv::Point(x0 - 1, 0);
+    
+    // Suzuki-Abe outer border following as in cv::findContours: the first
+    // neighbour clockwise from the west, then counterclockwise searches,
+    // keeping only the points where the direction changes
+    int s = 4;
+    const uint8_t* i1 = i0;
+    do {
+        s = (s - 1) & 7;
+        i1 = i0 + deltas[s];
+    } while (*i1 == 0 && s != 4);
+    
+    if (s == 4) {
+        arena.addPoint(point);  // Single pixel
+        return;
+    }
+    
+    const uint8_t* i3 = i0;
+    int prev_s = s ^ 4;
+    for (;;) {
+        const uint8_t* i4;
+        do {
+            i4 = i3 + deltas[++s];
+        } while (*i4 == 0);
+        s &= 7;
+        
+        if (s != prev_s) {
+            arena.addPoint(point);
+            prev_s = s;
+        }
+        point.x += kDx[s];
+        point.y += kDy[s];
+        
+        if (i4 == i0 && i3 == i1) break;
+        i3 = i4;
+        s = (s + 4) & 7;
+    }
+}
+
+} // namespace country_style
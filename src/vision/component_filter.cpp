@@ -0,0 +1,189 @@
+#include "component_filter.h"
+#include <algorithm>
+#include <cstring>
+
+namespace country_style {
+
+ComponentFilter::ComponentFilter()
+    : min_component_area_(0), max_hole_area_(0) {}
+
+void ComponentFilter::setLimits(int min_component_area, int max_hole_area) {
+    min_component_area_ = std::max(0, min_component_area);
+    max_hole_area_ = std::max(0, max_hole_area);
+}
+
+int ComponentFilter::newLabel(const Run& run, bool foreground, int outer, bool border) {
+    int label = static_cast<int>(parent_.size());
+    parent_.push_back(label);
+    area_.push_back(run.x1 - run.x0);
+    outer_.push_back(outer);
+    foreground_.push_back(foreground ? 1 : 0);
+    border_.push_back(border ? 1 : 0);
+    return label;
+}
+
+int ComponentFilter::findRoot(int label) {
+    while (parent_[label] != label) {
+        parent_[label] = parent_[parent_[label]];
+        label = parent_[label];
+    }
+    return label;
+}
+
+int ComponentFilter::merge(int a, int b) {
+    a = findRoot(a);
+    b = findRoot(b);
+    if (a == b) return a;
+    
+    // The older label stays the root, so parents precede their children
+    if (a > b) std::swap(a, b);
+    parent_[b] = a;
+    area_[a] += area_[b];
+    border_[a] |= border_[b];
+    return a;
+}
+
+template <typename RowRuns>
+bool ComponentFilter::labelComponents(int width, int height, RowRuns row_runs) {
+    if (min_component_area_ <= 1 && max_hole_area_ == 0) return false;
+    if (width <= 0 || height <= 0) return false;
+    
+    runs_.clear();
+    row_offsets_.clear();
+    parent_.clear();
+    area_.clear();
+    outer_.clear();
+    foreground_.clear();
+    border_.clear();
+    
+    // Labeling pass
+    size_t prev_begin = 0;
+    size_t prev_end = 0;
+    for (int y = 0; y < height; y++) {
+        const size_t row_begin = runs_.size();
+        row_offsets_.push_back(static_cast<int>(row_begin));
+        const bool edge_row = (y == 0 || y == height - 1);
+        
+        // Split the row into alternating background and foreground runs
+        row_runs_.clear();
+        row_runs(y, row_runs_);
+        int x = 0;
+        for (const auto& set : row_runs_) {
+            if (set[0] > x) runs_.push_back({x, set[0], -1, false});
+            runs_.push_back({set[0], set[1], -1, true});
+            x = set[1];
+        }
+        if (x < width) runs_.push_back({x, width, -1, false});
+        
+        size_t j = prev_begin;
+        for (size_t i = row_begin; i < runs_.size(); i++) {
+            Run& run = runs_[i];
+            const bool foreground = run.foreground;
+            const bool edge = edge_row || run.x0 == 0 || run.x1 == width;
+            
+            // Neighbours above: 8-connected for foreground (diagonals
+            // included), 4-connected for background
+            const int lo = foreground ? run.x0 - 1 : run.x0;
+            const int hi = foreground ? run.x1 : run.x1 - 1;
+            while (j < prev_end && runs_[j].x1 <= lo) j++;
+            
+            int label = -1;
+            for (size_t k = j; k < prev_end && runs_[k].x0 <= hi; k++) {
+                if (runs_[k].foreground != foreground) continue;
+                label = (label < 0) ? findRoot(runs_[k].label) : merge(label, runs_[k].label);
+            }
+            
+            if (label < 0) {
+                // First run of a new component. Its surrounding component is
+                // the run to the left (foreground) or the run above
+                // (background); neither can lie in one of its own holes.
+                int outer = -1;
+                if (foreground) {
+                    if (i > row_begin) outer = runs_[i - 1].label;
+                } else if (!edge) {
+                    outer = runs_[j].label;
+                }
+                label = newLabel(run, foreground, outer, edge);
+            } else {
+                area_[label] += run.x1 - run.x0;
+                if (edge) border_[label] = 1;
+            }
+            run.label = label;
+        }
+        
+        prev_begin = row_begin;
+        prev_end = runs_.size();
+    }
+    row_offsets_.push_back(static_cast<int>(runs_.size()));
+    
+    // Resolve each component once, oldest first: the component surrounding
+    // another always has the smaller label, so its verdict is already known
+    const size_t label_count = parent_.size();
+    set_.assign(label_count, 0);
+    for (size_t l = 0; l < label_count; l++) {
+        if (parent_[l] != static_cast<int>(l)) {
+            parent_[l] = parent_[parent_[l]];
+            continue;
+        }
+        
+        const int outer = outer_[l];
+        const bool outer_set = outer >= 0 && set_[parent_[outer]] != 0;
+        if (foreground_[l]) {
+            // Specks inside a filled hole are filled with it
+            set_[l] = (area_[l] >= min_component_area_ || outer_set) ? 1 : 0;
+        } else {
+            // Holes of a dropped piece are dropped with it
+            set_[l] = (max_hole_area_ > 0 && !border_[l] &&
+                       area_[l] <= max_hole_area_ && outer_set) ? 1 : 0;
+        }
+    }
+    return true;
+}
+
+void ComponentFilter::apply(cv::Mat& mask) {
+    if (mask.empty() || mask.type() != CV_8UC1) return;
+    
+    auto row_runs = [&mask](int y, std::vector<cv::Vec2i>& out) {
+        appendRowRuns(mask.ptr<uint8_t>(y), mask.cols, 0, out);
+    };
+    if (!labelComponents(mask.cols, mask.rows, row_runs)) return;
+    
+    // Rewrite only the runs whose value changes
+    for (int y = 0; y < mask.rows; y++) {
+        uint8_t* row = mask.ptr<uint8_t>(y);
+        for (int r = row_offsets_[y]; r < row_offsets_[y + 1]; r++) {
+            const Run& run = runs_[r];
+            const int root = parent_[run.label];
+            if (set_[root] != foreground_[root]) {
+                std::memset(row + run.x0, set_[root] ? 255 : 0, run.x1 - run.x0);
+            }
+        }
+    }
+}
+
+void ComponentFilter::apply(RleMask& mask) {
+    auto row_runs = [&mask](int y, std::vector<cv::Vec2i>& out) {
+        out.insert(out.end(), mask.runs.begin() + mask.rowBegin(y),
+                   mask.runs.begin() + mask.rowEnd(y));
+    };
+    if (!labelComponents(mask.bounds.width, mask.bounds.height, row_runs)) return;
+    
+    // Rebuild the runs from the set components, joining neighbours
+    mask.runs.clear();
+    for (int y = 0; y < mask.bounds.height; y++) {
+        const size_t row_begin = mask.runs.size();
+        mask.row_offsets[y] = static_cast<int>(row_begin);
+        for (int r = row_offsets_[y]; r < row_offsets_[y + 1]; r++) {
+            const Run& run = runs_[r];
+            if (!set_[parent_[run.label]]) continue;
+            if (mask.runs.size() > row_begin && mask.runs.back()[1] == run.x0) {
+                mask.runs.back()[1] = run.x1;
+            } else {
+                mask.runs.push_back(cv::Vec2i(run.x0, run.x1));
+            }
+        }
+    }
+    mask.row_offsets[mask.bounds.height] = static_cast<int>(mask.runs.size());
+}
+
+} // namespace country_style
@@ -1,4 +1,5 @@
 #include "config_manager.h"
+#include "contour_detector.h"
 #include <fstream>
 #include <iostream>
 
@@ -19,6 +20,20 @@ ConfigManager::ConfigManager() {
     config_.fps = 30;
     config_.morph_kernel_size = 5;
     config_.enable_preprocessing = true;
+    config_.use_color_lut = false;
+    config_.crop_to_roi = true;
+    config_.use_component_filter = false;
+    config_.min_component_area = 50;
+    config_.max_hole_area = 200;
+    config_.tiled_segmentation = true;
+    config_.thread_count = 1;
+    config_.coarse_factor = 1;
+    config_.change_gating = false;
+    config_.change_threshold = 4;
+    config_.piece_tracking = false;
+    config_.conveyor_direction = cv::Point2f(0.0f, 1.0f);
+    config_.track_max_missed = 2;
+    config_.belt_stitching = false;
 }
 
 ConfigManager::~ConfigManager() {}
@@ -95,6 +110,7 @@ nlohmann::json ConfigManager::configToJson() {
     j["roi"]["width"] = config_.roi.width;
     j["roi"]["height"] = config_.roi.height;
     
+    j["measurement_version"] = kMeasurementVersion;
     j["detection"]["min_area"] = config_.min_area;
     j["detection"]["max_area"] = config_.max_area;
     j["detection"]["min_circularity"] = config_.min_circularity;
@@ -107,12 +123,28 @@ nlohmann::json ConfigManager::configToJson() {
     
     j["processing"]["morph_kernel_size"] = config_.morph_kernel_size;
     j["processing"]["enable_preprocessing"] = config_.enable_preprocessing;
+    j["processing"]["use_color_lut"] = config_.use_color_lut;
+    j["processing"]["crop_to_roi"] = config_.crop_to_roi;
+    j["processing"]["use_component_filter"] = config_.use_component_filter;
+    j["processing"]["min_component_area"] = config_.min_component_area;
+    j["processing"]["max_hole_area"] = config_.max_hole_area;
+    j["processing"]["tiled_segmentation"] = config_.tiled_segmentation;
+    j["processing"]["thread_count"] = config_.thread_count;
+    j["processing"]["coarse_factor"] = config_.coarse_factor;
+    j["processing"]["change_gating"] = config_.change_gating;
+    j["processing"]["change_threshold"] = config_.change_threshold;
+    j["processing"]["piece_tracking"] = config_.piece_tracking;
+    j["processing"]["conveyor_direction"]["x"] = config_.conveyor_direction.x;
+    j["processing"]["conveyor_direction"]["y"] = config_.conveyor_direction.y;
+    j["processing"]["track_max_missed"] = config_.track_max_missed;
+    j["processing"]["belt_stitching"] = config_.belt_stitching;
     
     return j;
 }
 
 VisionConfig ConfigManager::jsonToConfig(const nlohmann::json& j) {
-    VisionConfig cfg;
+    // Sections missing from the file keep their current values
+    VisionConfig cfg = config_;
     
     if (j.contains("color_segmentation")) {
         auto lower = j["color_segmentation"]["lower"];
@@ -133,6 +165,14 @@ VisionConfig ConfigManager::jsonToConfig(const nlohmann::json& j) {
         cfg.max_area = j["detection"]["max_area"];
         cfg.min_circularity = j["detection"]["min_circularity"];
         cfg.max_circularity = j["detection"]["max_circularity"];
+        
+        // Limits saved before blobs were measured by pixel count
+        if (j.value("measurement_version", 1) < kMeasurementVersion) {
+            convertContourAreaLimits(cfg.min_area, cfg.max_area,
+                                     cfg.min_circularity, cfg.max_circularity);
+            std::cerr << "Config: detection area and circularity limits were set on traced "
+                      << "contours and have been converted to pixel counts" << std::endl;
+        }
     }
     
     if (j.contains("camera")) {
@@ -145,6 +185,24 @@ VisionConfig ConfigManager::jsonToConfig(const nlohmann::json& j) {
     if (j.contains("processing")) {
         cfg.morph_kernel_size = j["processing"]["morph_kernel_size"];
         cfg.enable_preprocessing = j["processing"]["enable_preprocessing"];
+        cfg.use_color_lut = j["processing"].value("use_color_lut", false);
+        cfg.crop_to_roi = j["processing"].value("crop_to_roi", true);
+        cfg.use_component_filter = j["processing"].value("use_component_filter", false);
+        cfg.min_component_area = j["processing"].value("min_component_area", 50);
+        cfg.max_hole_area = j["processing"].value("max_hole_area", 200);
+        cfg.tiled_segmentation = j["processing"].value("tiled_segmentation", true);
+        cfg.thread_count = j["processing"].value("thread_count", 1);
+        cfg.coarse_factor = j["processing"].value("coarse_factor", 1);
+        cfg.change_gating = j["processing"].value("change_gating", false);
+        cfg.change_threshold = j["processing"].value("change_threshold", 4);
+        cfg.piece_tracking = j["processing"].value("piece_tracking", false);
+        if (j["processing"].contains("conveyor_direction")) {
+            const auto& direction = j["processing"]["conveyor_direction"];
+            cfg.conveyor_direction = cv::Point2f(direction.value("x", 0.0f),
+                                                 direction.value("y", 1.0f));
+        }
+        cfg.track_max_missed = j["processing"].value("track_max_missed", 2);
+        cfg.belt_stitching = j["processing"].value("belt_stitching", false);
     }
     
     return cfg;
@@ -1,105 +1,80 @@
 #include "contour_detector.h"
+#include <algorithm>
+#include <cmath>
 
 namespace country_style {
 
-ContourDetector::ContourDetector() 
-    : retrieval_mode_(cv::RETR_EXTERNAL),
-      approximation_method_(cv::CHAIN_APPROX_SIMPLE) {}
+namespace {
 
-ContourDetector::~ContourDetector() {}
+double discPixelArea(double contour_area) {
+    return contour_area + 2.0 * std::sqrt(2.0 * contour_area / CV_PI) + 1.0;
+}
 
-std::vector<std::vector<cv::Point>> ContourDetector::findContours(const cv::Mat& mask) {
-    std::vector<std::vector<cv::Point>> contours;
-    std::vector<cv::Vec4i> hierarchy;
-    
-    if (mask.empty()) {
-        return contours;
+} // namespace
+
+void convertContourAreaLimits(double& min_area, double& max_area,
+                              double& min_circularity, double& max_circularity) {
+    // Typical piece size the circularity limits apply to
+    double typical = 0.0;
+    if (min_area > 0 && max_area > 0) {
+        typical = std::sqrt(min_area * max_area);
+    } else {
+        typical = std::max(min_area, max_area);
+    }
+    if (typical > 0) {
+        const double ratio = discPixelArea(typical) / typical;
+        min_circularity *= ratio;
+        max_circularity *= ratio;
     }
     
-    cv::findContours(mask.clone(), contours, hierarchy, 
-                     retrieval_mode_, approximation_method_);
-    
-    return contours;
+    if (min_area > 0) min_area = discPixelArea(min_area);
+    if (max_area > 0) max_area = discPixelArea(max_area);
 }
 
-std::vector<std::vector<cv::Point>> ContourDetector::filterByArea(
-    const std::vector<std::vector<cv::Point>>& contours,
-    double min_area, double max_area) {
-    
-    std::vector<std::vector<cv::Point>> filtered;
-    
-    for (const auto& contour : contours) {
-        double area = cv::contourArea(contour);
-        if (area >= min_area && area <= max_area) {
-            filtered.push_back(contour);
-        }
-    }
-    
-    return filtered;
+ContourDetector::ContourDetector() {}
+
+ContourDetector::~ContourDetector() {}
+
+void ContourDetector::measureBlobs(const RleMask& mask, std::vector<ContourFeatures>& features) {
+    collectFeatures(blob_labeler_.label(mask), features);
 }
 
-std::vector<ContourFeatures> ContourDetector::extractFeatures(
-    const std::vector<std::vector<cv::Point>>& contours) {
+void ContourDetector::collectFeatures(const std::vector<BlobStats>& blobs,
+                                      std::vector<ContourFeatures>& features) {
+    features.clear();
+    measured_blobs_.clear();
     
-    std::vector<ContourFeatures> features;
-    
-    for (const auto& contour : contours) {
-        ContourFeatures feat;
+    for (size_t i = 0; i < blobs.size(); i++) {
+        const BlobStats& blob = blobs[i];
         
-        // Calculate area
-        feat.area = cv::contourArea(contour);
-        
-        // Skip very small contours
-        if (feat.area < 100) {
+        // Skip very small blobs
+        if (blob.area < 100) {
             continue;
         }
         
-        // Calculate perimeter
-        feat.perimeter = cv::arcLength(contour, true);
+        ContourFeatures feat;
+        feat.area = blob.area;
+        feat.perimeter = blob.perimeter;
+        feat.bounding_box = blob.bbox;
+        feat.center = blob.centroid;
         
-        // Calculate circularity: 4*PI*area / perimeter^2
-        // Perfect circle = 1.0, less circular shapes < 1.0
+        // Circularity: 4*PI*area / perimeter^2
         if (feat.perimeter > 0) {
             feat.circularity = (4.0 * CV_PI * feat.area) / (feat.perimeter * feat.perimeter);
         } else {
             feat.circularity = 0.0;
         }
         
-        // Get bounding box
-        feat.bounding_box = cv::boundingRect(contour);
-        
-        // Calculate aspect ratio
-        if (feat.bounding_box.height > 0) {
-            feat.aspect_ratio = static_cast<double>(feat.bounding_box.width) / 
-                               static_cast<double>(feat.bounding_box.height);
-        } else {
-            feat.aspect_ratio = 0.0;
-        }
-        
-        // Calculate center
-        cv::Moments m = cv::moments(contour);
-        if (m.m00 != 0) {
-            feat.center = cv::Point2f(m.m10 / m.m00, m.m01 / m.m00);
-        } else {
-            feat.center = cv::Point2f(0, 0);
-        }
+        feat.aspect_ratio = static_cast<double>(feat.bounding_box.width) /
+                            static_cast<double>(feat.bounding_box.height);
         
         features.push_back(feat);
+        measured_blobs_.push_back(static_cast<int>(i));
     }
-    
-    return features;
 }
 
-cv::Mat ContourDetector::drawContours(const cv::Mat& frame,
-                                      const std::vector<std::vector<cv::Point>>& contours,
-                                      const cv::Scalar& color) {
-    cv::Mat output = frame.clone();
-    
-    for (size_t i = 0; i < contours.size(); i++) {
-        cv::drawContours(output, contours, static_cast<int>(i), color, 2);
-    }
-    
-    return output;
+void ContourDetector::traceBlob(size_t index, ContourArena& arena) {
+    blob_labeler_.traceContour(index < measured_blobs_.size() ? measured_blobs_[index] : -1, arena);
 }
 
 } // namespace country_style
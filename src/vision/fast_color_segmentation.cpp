@@ -1,139 +1,478 @@
 #include "fast_color_segmentation.h"
+#include "simd_kernels.h"
 #include <chrono>
-#include <immintrin.h>
+#include <functional>
+#include <algorithm>
+#include <iostream>
 
 namespace country_style {
 
+namespace {
+
+// Working set budget for one band's packed mask buffers, well inside the
+// L2 of the target CPUs
+const size_t kBandBytes = 256 * 1024;
+
+// Bands are not cut thinner than this to feed more threads
+const int kMinBandRows = 16;
+
+// Bounds are rounded and clamped like cv::inRange does for 8-bit
+int toColorBoxes(const std::vector<HsvRange>& ranges, ColorBox* boxes) {
+    int box_count = std::min(static_cast<int>(ranges.size()), kMaxColorBoxes);
+    for (int b = 0; b < box_count; b++) {
+        for (int c = 0; c < 3; c++) {
+            boxes[b].lower[c] = cv::saturate_cast<uint8_t>(ranges[b].lower[c]);
+            boxes[b].upper[c] = cv::saturate_cast<uint8_t>(ranges[b].upper[c]);
+        }
+    }
+    return box_count;
+}
+
+} // namespace
+
 FastColorSegmentation::FastColorSegmentation()
-    : morph_kernel_size_(5), last_processing_time_ms_(0.0) {
+    : morph_kernel_size_(5), use_binary_morphology_(false),
+      mask_cleaning_(MaskCleaning::Morphology), tiled_execution_(true),
+      last_processing_time_ms_(0.0),
+      segmentation_mode_(SegmentationMode::HsvThreshold), pending_generation_(0),
+      color_generation_(0) {
     
     // Default HSV range for dough (yellowish/beige)
-    lower_bound_ = cv::Scalar(20, 50, 50);
-    upper_bound_ = cv::Scalar(40, 255, 255);
+    color_ranges_ = {{cv::Scalar(20, 50, 50), cv::Scalar(40, 255, 255)}};
     
     // Initialize SIMD converter
     hsv_converter_ = std::make_unique<SimdHsvConverter>();
     
     // Pre-create morphological kernel (MATCHES JAVA: 5x5 ellipse)
-    morph_kernel_ = cv::getStructuringElement(
-        cv::MORPH_ELLIPSE,
-        cv::Size(morph_kernel_size_, morph_kernel_size_)
-    );
+    setMorphKernelSize(morph_kernel_size_);
+    
+    band_workers_.resize(1);
 }
 
-FastColorSegmentation::~FastColorSegmentation() {}
+FastColorSegmentation::~FastColorSegmentation() {
+    // Make any in-flight table build bail out, then wait for it
+    color_generation_++;
+    if (pending_lut_.valid()) {
+        pending_lut_.wait();
+    }
+}
 
 void FastColorSegmentation::setColorRange(const cv::Scalar& lower, const cv::Scalar& upper) {
-    lower_bound_ = lower;
-    upper_bound_ = upper;
+    setColorRanges({{lower, upper}});
+}
+
+void FastColorSegmentation::setColorRanges(const std::vector<HsvRange>& ranges) {
+    color_ranges_ = ranges;
+    if (color_ranges_.size() > static_cast<size_t>(kMaxColorBoxes)) {
+        std::cerr << "Warning: color model limited to " << kMaxColorBoxes
+                  << " boxes, ignoring " << (color_ranges_.size() - kMaxColorBoxes) << std::endl;
+        color_ranges_.resize(kMaxColorBoxes);
+    }
+    
+    color_generation_++;
+    if (segmentation_mode_ == SegmentationMode::DirectLut) {
+        requestColorLutRebuild();
+    }
+}
+
+void FastColorSegmentation::setSegmentationMode(SegmentationMode mode) {
+    segmentation_mode_ = mode;
+    if (segmentation_mode_ == SegmentationMode::DirectLut) {
+        requestColorLutRebuild();
+    }
+}
+
+bool FastColorSegmentation::isColorLutReady() {
+    collectColorLut();
+    return color_lut_ && color_lut_->generation == color_generation_.load();
+}
+
+void FastColorSegmentation::requestColorLutRebuild() {
+    uint64_t generation = color_generation_.load();
+    if (color_lut_ && color_lut_->generation == generation) {
+        return;
+    }
+    
+    // A build for this generation is already running; replacing it would
+    // wait for it to finish in full
+    if (pending_lut_.valid() && pending_generation_ == generation) {
+        return;
+    }
+    
+    // Replacing the future waits for a superseded build, which notices the
+    // generation change within one slice and stops early
+    pending_generation_ = generation;
+    pending_lut_ = std::async(std::launch::async, &FastColorSegmentation::buildColorLut,
+                              this, color_ranges_, generation);
 }
 
-void FastColorSegmentation::segment(const cv::Mat& frame, cv::Mat& mask) {
+void FastColorSegmentation::collectColorLut() {
+    if (!pending_lut_.valid() ||
+        pending_lut_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return;
+    }
+    
+    std::shared_ptr<const ColorLut> lut = pending_lut_.get();
+    if (lut && lut->generation == color_generation_.load()) {
+        color_lut_ = lut;
+    }
+}
+
+std::shared_ptr<const FastColorSegmentation::ColorLut> FastColorSegmentation::buildColorLut(
+    std::vector<HsvRange> ranges, uint64_t generation) {
+    
+    auto lut = std::make_shared<ColorLut>();
+    lut->generation = generation;
+    lut->bits.assign((1u << 24) / 64, 0);
+    
+    // Classify the BGR cube one red slice at a time (256x256 image with
+    // b along columns and g along rows) through the regular HSV path, so
+    // the table agrees exactly with HsvThreshold mode
+    cv::Mat slice(256, 256, CV_8UC3);
+    cv::Mat slice_hsv, slice_mask;
+    for (int g = 0; g < 256; g++) {
+        uint8_t* row = slice.ptr<uint8_t>(g);
+        for (int b = 0; b < 256; b++) {
+            row[b * 3 + 0] = static_cast<uint8_t>(b);
+            row[b * 3 + 1] = static_cast<uint8_t>(g);
+        }
+    }
+    
+    for (int r = 0; r < 256; r++) {
+        if (color_generation_.load() != generation) {
+            return nullptr;  // Range changed again; result would be stale
+        }
+        
+        for (int i = 0; i < 256 * 256; i++) {
+            slice.data[i * 3 + 2] = static_cast<uint8_t>(r);
+        }
+        hsv_converter_->convertBgrToHsv(slice, slice_hsv);
+        inRangeSIMD(slice_hsv, slice_mask, ranges);
+        
+        // Mask index g * 256 + b is color (r << 16 | g << 8 | b)
+        uint64_t* words = lut->bits.data() + r * (256 * 256 / 64);
+        const uint8_t* m = slice_mask.data;
+        for (int w = 0; w < 256 * 256 / 64; w++) {
+            uint64_t word = 0;
+            for (int bit = 0; bit < 64; bit++) {
+                word |= static_cast<uint64_t>(m[w * 64 + bit] & 1) << bit;
+            }
+            words[w] = word;
+        }
+    }
+    
+    return lut;
+}
+
+void FastColorSegmentation::segment(const cv::Mat& frame, RleMask& mask,
+                                    const RoiSpans* spans, const cv::Point& origin) {
     auto start = std::chrono::high_resolution_clock::now();
     
+    mask.reset(cv::Rect(origin.x, origin.y, frame.cols, frame.rows));
     if (frame.empty()) {
-        mask = cv::Mat();
         return;
     }
     
-    // Convert BGR to HSV using SIMD
-    hsv_converter_->convertBgrToHsv(frame, hsv_buffer_);
+    const bool use_lut = segmentation_mode_ == SegmentationMode::DirectLut && isColorLutReady();
+    ColorBox boxes[kMaxColorBoxes];
+    int box_count = toColorBoxes(color_ranges_, boxes);
     
-    // SIMD-optimized inRange operation
-    inRangeSIMD(hsv_buffer_, mask);
+    // Bands: L2-sized when tiling, and at least one per thread
+    int band_rows = frame.rows;
+    const int tile_rows = bandRows(frame.cols);
+    if (tiled_execution_ && tile_rows > 0) {
+        band_rows = std::min(band_rows, tile_rows);
+    }
+    const int threads = getThreadCount();
+    if (threads > 1) {
+        band_rows = std::min(band_rows, (frame.rows + threads - 1) / threads);
+    }
+    band_rows = std::max(band_rows, std::min(frame.rows, kMinBandRows));
     
-    // Clean up mask with optimized morphology
-    cleanMask(mask);
+    segmentBands(frame, mask, spans, band_rows, use_lut, boxes, box_count);
+    
+    // Closing can bridge gaps across the outside of a concave ROI
+    if (spans) {
+        clearOutsideSpans(mask, *spans, clip_buffer_);
+        std::swap(mask, clip_buffer_);
+    }
     
     auto end = std::chrono::high_resolution_clock::now();
     last_processing_time_ms_ = 
         std::chrono::duration<double, std::milli>(end - start).count();
 }
 
-void FastColorSegmentation::inRangeSIMD(const cv::Mat& hsv, cv::Mat& mask) {
-    // Ensure mask is allocated
-    if (mask.size() != hsv.size() || mask.type() != CV_8UC1) {
-        mask.create(hsv.size(), CV_8UC1);
+void FastColorSegmentation::classify(const cv::Mat& frame, RleMask& mask,
+                                     const RoiSpans* spans, const cv::Point& origin) {
+    mask.reset(cv::Rect(origin.x, origin.y, frame.cols, frame.rows));
+    if (frame.empty()) {
+        return;
     }
     
-    int total_pixels = hsv.rows * hsv.cols;
-    const uint8_t* hsv_data = hsv.data;
-    uint8_t* mask_data = mask.data;
-    
-    // Extract bounds
-    uint8_t h_min = static_cast<uint8_t>(lower_bound_[0]);
-    uint8_t s_min = static_cast<uint8_t>(lower_bound_[1]);
-    uint8_t v_min = static_cast<uint8_t>(lower_bound_[2]);
-    uint8_t h_max = static_cast<uint8_t>(upper_bound_[0]);
-    uint8_t s_max = static_cast<uint8_t>(upper_bound_[1]);
-    uint8_t v_max = static_cast<uint8_t>(upper_bound_[2]);
-    
-#ifdef __AVX2__
-    // Process 32 pixels at a time with AVX2
-    int simd_pixels = (total_pixels / 32) * 32;
-    
-    __m256i v_h_min = _mm256_set1_epi8(h_min);
-    __m256i v_h_max = _mm256_set1_epi8(h_max);
-    __m256i v_s_min = _mm256_set1_epi8(s_min);
-    __m256i v_s_max = _mm256_set1_epi8(s_max);
-    __m256i v_v_min = _mm256_set1_epi8(v_min);
-    __m256i v_v_max = _mm256_set1_epi8(v_max);
-    __m256i v_255 = _mm256_set1_epi8(255);
-    
-    for (int i = 0; i < simd_pixels; i += 32) {
-        // Load 32 HSV pixels (96 bytes)
-        // This is simplified - full implementation would deinterleave H,S,V channels
+    const bool use_lut = segmentation_mode_ == SegmentationMode::DirectLut && isColorLutReady();
+    ColorBox boxes[kMaxColorBoxes];
+    int box_count = toColorBoxes(color_ranges_, boxes);
+    for (int y = 0; y < frame.rows; y++) {
+        mask.row_offsets[y] = static_cast<int>(mask.runs.size());
+        appendClassifiedRow(frame, y, spans, use_lut, boxes, box_count,
+                            band_workers_[0], mask.runs);
+    }
+    mask.row_offsets[frame.rows] = static_cast<int>(mask.runs.size());
+}
+
+int FastColorSegmentation::getCleaningHalo() const {
+    if (mask_cleaning_ == MaskCleaning::Components) {
+        return 1;  // Components are kept or dropped whole
+    }
+    
+    // Eight open/close passes, each reaching half the kernel
+    return 8 * (morph_kernel_size_ / 2);
+}
+
+void FastColorSegmentation::appendClassifiedRow(const cv::Mat& frame, int y,
+                                                const RoiSpans* spans, bool use_lut,
+                                                const ColorBox* boxes, int box_count,
+                                                BandWorker& worker,
+                                                std::vector<cv::Vec2i>& runs) {
+    if (worker.mask_row.cols < frame.cols) {
+        worker.mask_row.create(1, frame.cols, CV_8UC1);
+        worker.hsv_row.create(1, frame.cols, CV_8UC3);
+    }
+    
+    if (!spans) {
+        classifyRow(frame, y, 0, frame.cols, use_lut, boxes, box_count, worker);
+        appendRowRuns(worker.mask_row.ptr<uint8_t>(), frame.cols, 0, runs);
+        return;
+    }
+    
+    // Polygon ROI: only the spans are converted and classified
+    if (y >= spans->bounds.height) return;
+    for (int s = spans->row_offsets[y]; s < spans->row_offsets[y + 1]; s++) {
+        const int begin = spans->spans[s][0];
+        const int end = std::min(spans->spans[s][1], frame.cols);
+        if (end <= begin) continue;
         
-        // For now, use scalar loop within SIMD block
-        for (int j = 0; j < 32; j++) {
-            int idx = (i + j) * 3;
-            uint8_t h = hsv_data[idx + 0];
-            uint8_t s = hsv_data[idx + 1];
-            uint8_t v = hsv_data[idx + 2];
-            
-            bool in_range = (h >= h_min && h <= h_max &&
-                           s >= s_min && s <= s_max &&
-                           v >= v_min && v <= v_max);
-            
-            mask_data[i + j] = in_range ? 255 : 0;
+        classifyRow(frame, y, begin, end, use_lut, boxes, box_count, worker);
+        appendRowRuns(worker.mask_row.ptr<uint8_t>(), end - begin, begin, runs);
+    }
+}
+
+int FastColorSegmentation::bandRows(int width) const {
+    if (mask_cleaning_ != MaskCleaning::Morphology || !use_binary_morphology_) {
+        return 0;
+    }
+    
+    // Source, destination and band scratch, 1 bit per pixel plus guard words
+    const int halo = haloRows();
+    const size_t row_bytes = 3 * (static_cast<size_t>(width + 63) / 64 + 2) * sizeof(uint64_t);
+    const int rows = static_cast<int>(kBandBytes / row_bytes) - 2 * halo;
+    
+    // Keep the halo overhead below half the band
+    return std::max(rows, 4 * halo);
+}
+
+void FastColorSegmentation::setThreadCount(int threads) {
+    if (threads == 1) {
+        thread_pool_.reset();
+    } else {
+        thread_pool_ = std::make_unique<ThreadPool>(threads);
+        if (thread_pool_->size() == 1) {
+            thread_pool_.reset();
         }
     }
+    band_workers_.resize(getThreadCount());
+}
+
+void FastColorSegmentation::segmentBands(const cv::Mat& frame, RleMask& mask,
+                                         const RoiSpans* spans, int band_rows, bool use_lut,
+                                         const ColorBox* boxes, int box_count) {
+    const int rows = frame.rows;
+    const int band_count = (rows + band_rows - 1) / band_rows;
+    bands_.resize(band_count);
+    band_times_ms_.assign(band_count, 0.0);
+    
+    // The band tasks go to the pool by reference: a std::function holding
+    // the lambdas themselves would allocate every frame
+    auto forEachBand = [this, band_count](const auto& task) {
+        if (thread_pool_) {
+            thread_pool_->parallelFor(band_count, std::cref(task));
+        } else {
+            for (int b = 0; b < band_count; b++) task(b, 0);
+        }
+    };
+    auto appendBand = [&mask](const RleMask& band) {
+        for (int y = 0; y < band.bounds.height; y++) {
+            mask.row_offsets[band.bounds.y + y] = static_cast<int>(mask.runs.size());
+            mask.runs.insert(mask.runs.end(), band.runs.begin() + band.rowBegin(y),
+                             band.runs.begin() + band.rowEnd(y));
+        }
+    };
     
-    // Handle remainder
-    for (int i = simd_pixels; i < total_pixels; i++) {
-        int idx = i * 3;
-        uint8_t h = hsv_data[idx + 0];
-        uint8_t s = hsv_data[idx + 1];
-        uint8_t v = hsv_data[idx + 2];
+    // Classify each band's own rows; every frame row is read exactly once
+    forEachBand([&](int b, int w) {
+        auto start = std::chrono::high_resolution_clock::now();
+        const int top = b * band_rows;
+        const int bottom = std::min(top + band_rows, rows);
+        RleMask& raw = bands_[b].raw;
+        raw.reset(cv::Rect(0, top, frame.cols, bottom - top));
+        for (int y = top; y < bottom; y++) {
+            raw.row_offsets[y - top] = static_cast<int>(raw.runs.size());
+            appendClassifiedRow(frame, y, spans, use_lut, boxes, box_count,
+                                band_workers_[w], raw.runs);
+        }
+        raw.row_offsets[bottom - top] = static_cast<int>(raw.runs.size());
+        band_times_ms_[b] = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+    });
+        
+    if (bandRows(frame.cols) == 0) {
+        // Component cleaning and the cv::morphologyEx fallback see the
+        // whole mask
+        for (const auto& band : bands_) appendBand(band.raw);
+        mask.row_offsets[rows] = static_cast<int>(mask.runs.size());
+        cleanMask(mask);
+        return;
+    }
         
-        bool in_range = (h >= h_min && h <= h_max &&
-                       s >= s_min && s <= s_max &&
-                       v >= v_min && v <= v_max);
+    // Clean each band once its neighbours are classified
+    forEachBand([&](int b, int w) {
+        auto start = std::chrono::high_resolution_clock::now();
+        cleanBand(b, band_rows, rows, band_workers_[w]);
+        band_times_ms_[b] += std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+    });
         
-        mask_data[i] = in_range ? 255 : 0;
+    for (const auto& band : bands_) appendBand(band.cleaned);
+    mask.row_offsets[rows] = static_cast<int>(mask.runs.size());
+}
+
+void FastColorSegmentation::cleanBand(int band, int band_rows, int rows, BandWorker& worker) {
+    if (worker.kernel_size != morph_kernel_size_) {
+        worker.morphology.setKernel(morph_kernel_);
+        worker.kernel_size = morph_kernel_size_;
+    }
+    
+    // The band plus halo rows from its neighbours' classified rows. Cleaned
+    // as a standalone image, rows more than the halo from a cut are exact,
+    // and the frame's own top and bottom edges pad as they would untiled.
+    const RleMask& own = bands_[band].raw;
+    const int top = own.bounds.y;
+    const int bottom = top + own.bounds.height;
+    const int window_top = std::max(0, top - haloRows());
+    const int window_bottom = std::min(rows, bottom + haloRows());
+    
+    RleMask& window = worker.window;
+    window.reset(cv::Rect(0, window_top, own.bounds.width, window_bottom - window_top));
+    for (int y = window_top; y < window_bottom; y++) {
+        const RleMask& source = bands_[y / band_rows].raw;
+        const int source_y = y - source.bounds.y;
+        window.row_offsets[y - window_top] = static_cast<int>(window.runs.size());
+        window.runs.insert(window.runs.end(), source.runs.begin() + source.rowBegin(source_y),
+                           source.runs.begin() + source.rowEnd(source_y));
+    }
+    window.row_offsets[window_bottom - window_top] = static_cast<int>(window.runs.size());
+    
+    worker.morphology.openClose(window, 2, 2);
+    
+    // Keep only the band's own rows
+    RleMask& cleaned = bands_[band].cleaned;
+    cleaned.reset(own.bounds);
+    for (int y = top; y < bottom; y++) {
+        cleaned.row_offsets[y - top] = static_cast<int>(cleaned.runs.size());
+        cleaned.runs.insert(cleaned.runs.end(),
+                            window.runs.begin() + window.rowBegin(y - window_top),
+                            window.runs.begin() + window.rowEnd(y - window_top));
+    }
+    cleaned.row_offsets[bottom - top] = static_cast<int>(cleaned.runs.size());
+}
+
+void FastColorSegmentation::classifyRow(const cv::Mat& frame, int y, int begin, int end,
+                                        bool use_lut, const ColorBox* boxes, int box_count,
+                                        BandWorker& worker) {
+    const cv::Rect run(begin, y, end - begin, 1);
+    const cv::Rect row_part(0, 0, end - begin, 1);
+    cv::Mat mask_run = worker.mask_row(row_part);
+    if (use_lut) {
+        hsv_converter_->convertBgrToMaskLut(frame(run), color_lut_->bits.data(), mask_run);
+    } else {
+        cv::Mat hsv_run = worker.hsv_row(row_part);
+        hsv_converter_->convertBgrToHsv(frame(run), hsv_run);
+        simdKernels().in_range(hsv_run.ptr<uint8_t>(), mask_run.ptr<uint8_t>(),
+                               end - begin, boxes, box_count);
+    }
+}
+
+void FastColorSegmentation::inRangeSIMD(const cv::Mat& hsv, cv::Mat& mask,
+                                        const std::vector<HsvRange>& ranges) {
+    // Ensure mask is allocated
+    if (mask.size() != hsv.size() || mask.type() != CV_8UC1) {
+        mask.create(hsv.size(), CV_8UC1);
+    }
+    
+    ColorBox boxes[kMaxColorBoxes];
+    int box_count = toColorBoxes(ranges, boxes);
+
+    // Deinterleaving range test for the instruction set selected at startup,
+    // row by row so views and padded buffers work in place
+    int rows = hsv.rows;
+    int cols = hsv.cols;
+    if (hsv.isContinuous() && mask.isContinuous()) {
+        cols *= rows;
+        rows = 1;
     }
-#else
-    // Fallback to OpenCV inRange
-    cv::inRange(hsv, lower_bound_, upper_bound_, mask);
-#endif
+    for (int y = 0; y < rows; y++) {
+        simdKernels().in_range(hsv.ptr<uint8_t>(y), mask.ptr<uint8_t>(y), cols, boxes, box_count);
+    }
+}
+
+void FastColorSegmentation::setMorphKernelSize(int size) {
+    morph_kernel_size_ = std::max(1, size);
+    morph_kernel_ = cv::getStructuringElement(
+        cv::MORPH_ELLIPSE,
+        cv::Size(morph_kernel_size_, morph_kernel_size_)
+    );
+    use_binary_morphology_ = binary_morphology_.setKernel(morph_kernel_);
+}
+
+void FastColorSegmentation::setComponentLimits(int min_component_area, int max_hole_area) {
+    component_filter_.setLimits(min_component_area, max_hole_area);
 }
 
-void FastColorSegmentation::cleanMask(cv::Mat& mask) {
-    if (mask.empty()) return;
+void FastColorSegmentation::cleanMask(RleMask& mask) {
+    if (mask.bounds.area() <= 0) return;
+    
+    if (mask_cleaning_ == MaskCleaning::Components) {
+        component_filter_.apply(mask);
+        return;
+    }
+    if (use_binary_morphology_) {
+        binary_morphology_.openClose(mask, 2, 2);
+        return;
+    }
+    
+    // Kernel does not decompose: clean a dense copy with cv::morphologyEx
+    dense_buffer_.create(mask.bounds.size(), CV_8UC1);
+    decodeMask(mask, dense_buffer_);
     
     // MATCHES JAVA EXACTLY:
     // Remove noise with opening (erosion followed by dilation) - 2 iterations
-    cv::morphologyEx(mask, mask, cv::MORPH_OPEN, morph_kernel_, 
-                     cv::Point(-1, -1), 2);
+    cv::morphologyEx(dense_buffer_, dense_buffer_, cv::MORPH_OPEN, morph_kernel_, 
+                     cv::Point(-1, -1), 2, cv::BORDER_CONSTANT);
     
     // Fill gaps with closing (dilation followed by erosion) - 2 iterations
-    cv::morphologyEx(mask, mask, cv::MORPH_CLOSE, morph_kernel_, 
-                     cv::Point(-1, -1), 2);
+    cv::morphologyEx(dense_buffer_, dense_buffer_, cv::MORPH_CLOSE, morph_kernel_, 
+                     cv::Point(-1, -1), 2, cv::BORDER_CONSTANT);
+    
+    encodeMask(dense_buffer_, mask, mask.bounds.tl());
 }
 
 void FastColorSegmentation::getColorRange(cv::Scalar& lower, cv::Scalar& upper) const {
-    lower = lower_bound_;
-    upper = upper_bound_;
+    if (color_ranges_.empty()) {
+        lower = upper = cv::Scalar();
+        return;
+    }
+    lower = color_ranges_[0].lower;
+    upper = color_ranges_[0].upper;
 }
 
 } // namespace country_style
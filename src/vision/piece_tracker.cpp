@@ -0,0 +1,110 @@
+#include "piece_tracker.h"
+#include <algorithm>
+#include <cmath>
+
+namespace country_style {
+
+PieceTracker::PieceTracker()
+    : direction_(0.0f, 1.0f), max_missed_(2), next_id_(1) {}
+
+void PieceTracker::setDirection(const cv::Point2f& direction) {
+    const float length = std::sqrt(direction.dot(direction));
+    if (length > 0.0f) {
+        direction_ = direction * (1.0f / length);
+    }
+}
+
+void PieceTracker::setMaxMissed(int frames) {
+    max_missed_ = std::max(0, frames);
+}
+
+void PieceTracker::reset() {
+    tracks_.clear();
+}
+
+void PieceTracker::update(const std::vector<cv::Point2f>& centers, const std::vector<cv::Rect>& boxes,
+                          const cv::Rect& area, std::vector<int>& track_ids, std::vector<int>& ended) {
+    const size_t detections = centers.size();
+    track_ids.assign(detections, -1);
+    ended.clear();
+    
+    // Candidate pairs: the detection overlaps the track's predicted box, or
+    // lies within one box size of its predicted center
+    matches_.clear();
+    predicted_.resize(tracks_.size());
+    for (size_t t = 0; t < tracks_.size(); t++) {
+        const PieceTrack& track = tracks_[t];
+        const cv::Point2f shift = direction_ * (track.speed * (track.missed + 1));
+        predicted_[t] = track.center + shift;
+        const cv::Rect box = track.bbox + cv::Point(cvRound(shift.x), cvRound(shift.y));
+        const float reach = static_cast<float>(std::max(box.width, box.height));
+        for (size_t d = 0; d < detections; d++) {
+            const cv::Point2f offset = centers[d] - predicted_[t];
+            const float distance = std::sqrt(offset.dot(offset));
+            if ((box & boxes[d]).area() > 0 || distance <= reach) {
+                matches_.push_back({distance, static_cast<int>(t), static_cast<int>(d)});
+            }
+        }
+    }
+    
+    // Nearest pairs first, each track and detection used once
+    std::sort(matches_.begin(), matches_.end(),
+              [](const Match& a, const Match& b) { return a.distance < b.distance; });
+    track_detection_.assign(tracks_.size(), -1);
+    for (const Match& match : matches_) {
+        if (track_detection_[match.track] >= 0 || track_ids[match.detection] >= 0) continue;
+        track_detection_[match.track] = match.detection;
+        track_ids[match.detection] = tracks_[match.track].id;
+    }
+    
+    // Update matched tracks, age the others. The belt moves every piece at
+    // the same speed, so new tracks start from the mean of the known ones.
+    float speed_sum = 0.0f;
+    int speed_count = 0;
+    for (size_t t = 0; t < tracks_.size(); t++) {
+        PieceTrack& track = tracks_[t];
+        const int d = track_detection_[t];
+        if (d < 0) {
+            track.missed++;
+            continue;
+        }
+        
+        const float step = (centers[d] - track.center).dot(direction_) / (track.missed + 1);
+        track.speed = (track.hits > 1) ? 0.5f * (track.speed + step) : step;
+        track.center = centers[d];
+        track.bbox = boxes[d];
+        track.hits++;
+        track.missed = 0;
+        speed_sum += track.speed;
+        speed_count++;
+    }
+    
+    // A track ends once its piece should have left the area, or after too
+    // many frames unseen
+    size_t kept = 0;
+    for (size_t t = 0; t < tracks_.size(); t++) {
+        const PieceTrack& track = tracks_[t];
+        if (track.missed > 0 && (track.missed > max_missed_ || !area.contains(predicted_[t]))) {
+            ended.push_back(track.id);
+            continue;
+        }
+        tracks_[kept++] = track;
+    }
+    tracks_.resize(kept);
+    
+    const float speed = speed_count > 0 ? speed_sum / speed_count : 0.0f;
+    for (size_t d = 0; d < detections; d++) {
+        if (track_ids[d] >= 0) continue;
+        PieceTrack track;
+        track.id = next_id_++;
+        track.center = centers[d];
+        track.bbox = boxes[d];
+        track.speed = speed;
+        track.hits = 1;
+        track.missed = 0;
+        tracks_.push_back(track);
+        track_ids[d] = track.id;
+    }
+}
+
+} // namespace country_style
@@ -12,6 +12,110 @@ using json = nlohmann::json;
 
 namespace country_style {
 
+namespace {
+
+// Quality thresholds <-> JSON, shared by the recipe and its lanes
+json qualityToJson(const QualityThresholds& t) {
+    json j;
+    
+    // Enable flags
+    j["enable_area_check"] = t.enable_area_check;
+    j["enable_width_check"] = t.enable_width_check;
+    j["enable_height_check"] = t.enable_height_check;
+    j["enable_aspect_ratio_check"] = t.enable_aspect_ratio_check;
+    j["enable_circularity_check"] = t.enable_circularity_check;
+    j["enable_count_check"] = t.enable_count_check;
+    
+    j["expected_count"] = t.expected_count;
+    j["enforce_exact_count"] = t.enforce_exact_count;
+    j["min_count"] = t.min_count;
+    j["max_count"] = t.max_count;
+    j["min_area"] = t.min_area;
+    j["max_area"] = t.max_area;
+    j["min_width"] = t.min_width;
+    j["max_width"] = t.max_width;
+    j["min_height"] = t.min_height;
+    j["max_height"] = t.max_height;
+    j["min_aspect_ratio"] = t.min_aspect_ratio;
+    j["max_aspect_ratio"] = t.max_aspect_ratio;
+    j["min_circularity"] = t.min_circularity;
+    j["max_circularity"] = t.max_circularity;
+    j["fail_on_undersized"] = t.fail_on_undersized;
+    j["fail_on_oversized"] = t.fail_on_oversized;
+    j["fail_on_count_mismatch"] = t.fail_on_count_mismatch;
+    j["fail_on_shape_defects"] = t.fail_on_shape_defects;
+    return j;
+}
+
+void jsonToQuality(const json& q, QualityThresholds& t) {
+    // Enable flags
+    t.enable_area_check = q.value("enable_area_check", false);
+    t.enable_width_check = q.value("enable_width_check", false);
+    t.enable_height_check = q.value("enable_height_check", false);
+    t.enable_aspect_ratio_check = q.value("enable_aspect_ratio_check", false);
+    t.enable_circularity_check = q.value("enable_circularity_check", false);
+    t.enable_count_check = q.value("enable_count_check", false);
+    
+    t.expected_count = q.value("expected_count", 0);
+    t.enforce_exact_count = q.value("enforce_exact_count", false);
+    t.min_count = q.value("min_count", 0);
+    t.max_count = q.value("max_count", 100);
+    t.min_area = q.value("min_area", 0.0);
+    t.max_area = q.value("max_area", 100000.0);
+    t.min_width = q.value("min_width", 0.0);
+    t.max_width = q.value("max_width", 1000.0);
+    t.min_height = q.value("min_height", 0.0);
+    t.max_height = q.value("max_height", 1000.0);
+    t.min_aspect_ratio = q.value("min_aspect_ratio", 0.0);
+    t.max_aspect_ratio = q.value("max_aspect_ratio", 10.0);
+    t.min_circularity = q.value("min_circularity", 0.0);
+    t.max_circularity = q.value("max_circularity", 1.0);
+    t.fail_on_undersized = q.value("fail_on_undersized", true);
+    t.fail_on_oversized = q.value("fail_on_oversized", true);
+    t.fail_on_count_mismatch = q.value("fail_on_count_mismatch", true);
+    t.fail_on_shape_defects = q.value("fail_on_shape_defects", true);
+}
+
+// Area and circularity limits of a recipe saved with measurement version 1
+void convertLimits(QualityThresholds& t) {
+    convertContourAreaLimits(t.min_area, t.max_area, t.min_circularity, t.max_circularity);
+}
+
+void convertLimits(Recipe& recipe) {
+    DetectionRules& rules = recipe.detection_rules;
+    convertContourAreaLimits(rules.min_area, rules.max_area,
+                             rules.min_circularity, rules.max_circularity);
+    convertLimits(recipe.quality_thresholds);
+    for (auto& lane : recipe.lanes) {
+        convertLimits(lane.thresholds);
+    }
+}
+
+// Polygons are stored as [[x, y], ...]
+json polygonToJson(const Polygon& polygon) {
+    json points = json::array();
+    for (const auto& p : polygon.points) {
+        points.push_back({p.x, p.y});
+    }
+    return points;
+}
+
+Polygon jsonToPolygon(const json& points) {
+    Polygon polygon;
+    polygon.is_good_sample = true;
+    polygon.color = cv::Scalar(255, 255, 0);
+    if (points.is_array()) {
+        for (const auto& p : points) {
+            if (p.is_array() && p.size() >= 2) {
+                polygon.points.push_back(cv::Point2f(p[0].get<float>(), p[1].get<float>()));
+            }
+        }
+    }
+    return polygon;
+}
+
+} // namespace
+
 RecipeManager::RecipeManager() {}
 
 RecipeManager::~RecipeManager() {}
@@ -49,10 +153,23 @@ bool RecipeManager::recipeToJson(const Recipe& recipe, json& j) {
     try {
         j["name"] = recipe.name;
         j["description"] = recipe.description;
+        j["measurement_version"] = kMeasurementVersion;
+        
+        // HSV ranges
+        j["hsv_ranges"] = json::array();
+        for (const auto& range : recipe.hsv_ranges) {
+            j["hsv_ranges"].push_back({
+                {"lower", {range.lower[0], range.lower[1], range.lower[2]}},
+                {"upper", {range.upper[0], range.upper[1], range.upper[2]}}
+            });
+        }
         
-        // HSV range
-        j["hsv_lower"] = {recipe.hsv_lower[0], recipe.hsv_lower[1], recipe.hsv_lower[2]};
-        j["hsv_upper"] = {recipe.hsv_upper[0], recipe.hsv_upper[1], recipe.hsv_upper[2]};
+        // First box again under the single-range keys for older readers
+        if (!recipe.hsv_ranges.empty()) {
+            const HsvRange& first = recipe.hsv_ranges[0];
+            j["hsv_lower"] = {first.lower[0], first.lower[1], first.lower[2]};
+            j["hsv_upper"] = {first.upper[0], first.upper[1], first.upper[2]};
+        }
         
         // ROI
         j["roi"]["x"] = recipe.roi.x;
@@ -60,6 +177,11 @@ bool RecipeManager::recipeToJson(const Recipe& recipe, json& j) {
         j["roi"]["width"] = recipe.roi.width;
         j["roi"]["height"] = recipe.roi.height;
         
+        j["roi_polygons"] = json::array();
+        for (const auto& polygon : recipe.roi_polygons) {
+            j["roi_polygons"].push_back(polygonToJson(polygon));
+        }
+        
         // Detection rules
         j["detection_rules"]["min_area"] = recipe.detection_rules.min_area;
         j["detection_rules"]["max_area"] = recipe.detection_rules.max_area;
@@ -69,36 +191,24 @@ bool RecipeManager::recipeToJson(const Recipe& recipe, json& j) {
         j["detection_rules"]["max_aspect_ratio"] = recipe.detection_rules.max_aspect_ratio;
         
         // Quality thresholds
-        // Enable flags
-        j["quality"]["enable_area_check"] = recipe.quality_thresholds.enable_area_check;
-        j["quality"]["enable_width_check"] = recipe.quality_thresholds.enable_width_check;
-        j["quality"]["enable_height_check"] = recipe.quality_thresholds.enable_height_check;
-        j["quality"]["enable_aspect_ratio_check"] = recipe.quality_thresholds.enable_aspect_ratio_check;
-        j["quality"]["enable_circularity_check"] = recipe.quality_thresholds.enable_circularity_check;
-        j["quality"]["enable_count_check"] = recipe.quality_thresholds.enable_count_check;
+        j["quality"] = qualityToJson(recipe.quality_thresholds);
         
-        j["quality"]["expected_count"] = recipe.quality_thresholds.expected_count;
-        j["quality"]["enforce_exact_count"] = recipe.quality_thresholds.enforce_exact_count;
-        j["quality"]["min_count"] = recipe.quality_thresholds.min_count;
-        j["quality"]["max_count"] = recipe.quality_thresholds.max_count;
-        j["quality"]["min_area"] = recipe.quality_thresholds.min_area;
-        j["quality"]["max_area"] = recipe.quality_thresholds.max_area;
-        j["quality"]["min_width"] = recipe.quality_thresholds.min_width;
-        j["quality"]["max_width"] = recipe.quality_thresholds.max_width;
-        j["quality"]["min_height"] = recipe.quality_thresholds.min_height;
-        j["quality"]["max_height"] = recipe.quality_thresholds.max_height;
-        j["quality"]["min_aspect_ratio"] = recipe.quality_thresholds.min_aspect_ratio;
-        j["quality"]["max_aspect_ratio"] = recipe.quality_thresholds.max_aspect_ratio;
-        j["quality"]["min_circularity"] = recipe.quality_thresholds.min_circularity;
-        j["quality"]["max_circularity"] = recipe.quality_thresholds.max_circularity;
-        j["quality"]["fail_on_undersized"] = recipe.quality_thresholds.fail_on_undersized;
-        j["quality"]["fail_on_oversized"] = recipe.quality_thresholds.fail_on_oversized;
-        j["quality"]["fail_on_count_mismatch"] = recipe.quality_thresholds.fail_on_count_mismatch;
-        j["quality"]["fail_on_shape_defects"] = recipe.quality_thresholds.fail_on_shape_defects;
+        // Lanes
+        j["lanes"] = json::array();
+        for (const auto& lane : recipe.lanes) {
+            j["lanes"].push_back({
+                {"name", lane.name},
+                {"region", polygonToJson(lane.region)},
+                {"quality", qualityToJson(lane.thresholds)}
+            });
+        }
         
         // Processing parameters
         j["processing"]["morph_kernel_size"] = recipe.morph_kernel_size;
         j["processing"]["enable_preprocessing"] = recipe.enable_preprocessing;
+        j["processing"]["use_component_filter"] = recipe.use_component_filter;
+        j["processing"]["min_component_area"] = recipe.min_component_area;
+        j["processing"]["max_hole_area"] = recipe.max_hole_area;
         
         // Metadata
         j["metadata"]["created_date"] = recipe.created_date;
@@ -117,12 +227,25 @@ bool RecipeManager::jsonToRecipe(const json& j, Recipe& recipe) {
         recipe.name = j.value("name", "");
         recipe.description = j.value("description", "");
         
-        // HSV range
-        if (j.contains("hsv_lower") && j["hsv_lower"].is_array() && j["hsv_lower"].size() >= 3) {
-            recipe.hsv_lower = cv::Scalar(j["hsv_lower"][0], j["hsv_lower"][1], j["hsv_lower"][2]);
-        }
-        if (j.contains("hsv_upper") && j["hsv_upper"].is_array() && j["hsv_upper"].size() >= 3) {
-            recipe.hsv_upper = cv::Scalar(j["hsv_upper"][0], j["hsv_upper"][1], j["hsv_upper"][2]);
+        // HSV ranges (recipes from before multi-box support have one range)
+        recipe.hsv_ranges.clear();
+        if (j.contains("hsv_ranges") && j["hsv_ranges"].is_array()) {
+            for (const auto& r : j["hsv_ranges"]) {
+                if (!r.contains("lower") || !r.contains("upper") ||
+                    r["lower"].size() < 3 || r["upper"].size() < 3) {
+                    continue;
+                }
+                HsvRange range;
+                range.lower = cv::Scalar(r["lower"][0], r["lower"][1], r["lower"][2]);
+                range.upper = cv::Scalar(r["upper"][0], r["upper"][1], r["upper"][2]);
+                recipe.hsv_ranges.push_back(range);
+            }
+        } else if (j.contains("hsv_lower") && j["hsv_lower"].is_array() && j["hsv_lower"].size() >= 3 &&
+                   j.contains("hsv_upper") && j["hsv_upper"].is_array() && j["hsv_upper"].size() >= 3) {
+            HsvRange range;
+            range.lower = cv::Scalar(j["hsv_lower"][0], j["hsv_lower"][1], j["hsv_lower"][2]);
+            range.upper = cv::Scalar(j["hsv_upper"][0], j["hsv_upper"][1], j["hsv_upper"][2]);
+            recipe.hsv_ranges.push_back(range);
         }
         
         // ROI
@@ -133,6 +256,16 @@ bool RecipeManager::jsonToRecipe(const json& j, Recipe& recipe) {
             recipe.roi.height = j["roi"].value("height", 480);
         }
         
+        recipe.roi_polygons.clear();
+        if (j.contains("roi_polygons") && j["roi_polygons"].is_array()) {
+            for (const auto& points : j["roi_polygons"]) {
+                Polygon polygon = jsonToPolygon(points);
+                if (polygon.points.size() >= 3) {
+                    recipe.roi_polygons.push_back(polygon);
+                }
+            }
+        }
+        
         // Detection rules
         if (j.contains("detection_rules")) {
             auto& dr = j["detection_rules"];
@@ -146,39 +279,38 @@ bool RecipeManager::jsonToRecipe(const json& j, Recipe& recipe) {
         
         // Quality thresholds
         if (j.contains("quality")) {
-            auto& q = j["quality"];
-            // Enable flags
-            recipe.quality_thresholds.enable_area_check = q.value("enable_area_check", false);
-            recipe.quality_thresholds.enable_width_check = q.value("enable_width_check", false);
-            recipe.quality_thresholds.enable_height_check = q.value("enable_height_check", false);
-            recipe.quality_thresholds.enable_aspect_ratio_check = q.value("enable_aspect_ratio_check", false);
-            recipe.quality_thresholds.enable_circularity_check = q.value("enable_circularity_check", false);
-            recipe.quality_thresholds.enable_count_check = q.value("enable_count_check", false);
+            jsonToQuality(j["quality"], recipe.quality_thresholds);
+        }
             
-            recipe.quality_thresholds.expected_count = q.value("expected_count", 0);
-            recipe.quality_thresholds.enforce_exact_count = q.value("enforce_exact_count", false);
-            recipe.quality_thresholds.min_count = q.value("min_count", 0);
-            recipe.quality_thresholds.max_count = q.value("max_count", 100);
-            recipe.quality_thresholds.min_area = q.value("min_area", 0.0);
-            recipe.quality_thresholds.max_area = q.value("max_area", 100000.0);
-            recipe.quality_thresholds.min_width = q.value("min_width", 0.0);
-            recipe.quality_thresholds.max_width = q.value("max_width", 1000.0);
-            recipe.quality_thresholds.min_height = q.value("min_height", 0.0);
-            recipe.quality_thresholds.max_height = q.value("max_height", 1000.0);
-            recipe.quality_thresholds.min_aspect_ratio = q.value("min_aspect_ratio", 0.0);
-            recipe.quality_thresholds.max_aspect_ratio = q.value("max_aspect_ratio", 10.0);
-            recipe.quality_thresholds.min_circularity = q.value("min_circularity", 0.0);
-            recipe.quality_thresholds.max_circularity = q.value("max_circularity", 1.0);
-            recipe.quality_thresholds.fail_on_undersized = q.value("fail_on_undersized", true);
-            recipe.quality_thresholds.fail_on_oversized = q.value("fail_on_oversized", true);
-            recipe.quality_thresholds.fail_on_count_mismatch = q.value("fail_on_count_mismatch", true);
-            recipe.quality_thresholds.fail_on_shape_defects = q.value("fail_on_shape_defects", true);
+        // Lanes
+        recipe.lanes.clear();
+        if (j.contains("lanes") && j["lanes"].is_array()) {
+            for (const auto& l : j["lanes"]) {
+                InspectionLane lane;
+                lane.name = l.value("name", "Lane " + std::to_string(recipe.lanes.size() + 1));
+                lane.region = jsonToPolygon(l.contains("region") ? l["region"] : json());
+                jsonToQuality(l.contains("quality") ? l["quality"] : json::object(), lane.thresholds);
+                if (lane.region.points.size() >= 3) {
+                    recipe.lanes.push_back(lane);
+                }
+            }
+        }
+        
+        // Limits saved before blobs were measured by pixel count
+        if (j.value("measurement_version", 1) < kMeasurementVersion) {
+            convertLimits(recipe);
+            std::cerr << "Recipe '" << recipe.name << "': area and circularity limits were "
+                      << "set on traced contours and have been converted to pixel counts; "
+                      << "check them and save the recipe" << std::endl;
         }
         
         // Processing parameters
         if (j.contains("processing")) {
             recipe.morph_kernel_size = j["processing"].value("morph_kernel_size", 5);
             recipe.enable_preprocessing = j["processing"].value("enable_preprocessing", true);
+            recipe.use_component_filter = j["processing"].value("use_component_filter", false);
+            recipe.min_component_area = j["processing"].value("min_component_area", 50);
+            recipe.max_hole_area = j["processing"].value("max_hole_area", 200);
         }
         
         // Metadata
@@ -351,10 +483,16 @@ bool RecipeManager::setActiveRecipe(const std::string& name) {
 void RecipeManager::applyRecipeToPipeline(VisionPipeline* pipeline, const Recipe& recipe) {
     if (!pipeline) return;
     
-    pipeline->updateColorRange(recipe.hsv_lower, recipe.hsv_upper);
+    pipeline->updateColorRanges(recipe.hsv_ranges);
     pipeline->updateROI(recipe.roi);
+    pipeline->updateROIPolygons(recipe.roi_polygons);
+    pipeline->updateLanes(recipe.lanes);
     pipeline->updateDetectionRules(recipe.detection_rules);
     pipeline->updateQualityThresholds(recipe.quality_thresholds);
+    pipeline->updateMorphKernelSize(recipe.morph_kernel_size);
+    pipeline->updateMaskCleaning(recipe.use_component_filter ? MaskCleaning::Components
+                                                             : MaskCleaning::Morphology);
+    pipeline->updateComponentLimits(recipe.min_component_area, recipe.max_hole_area);
 }
 
 bool RecipeManager::exportRecipe(const std::string& name, const std::string& export_path) {
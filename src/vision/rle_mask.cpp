@@ -0,0 +1,108 @@
+#include "rle_mask.h"
+#include <algorithm>
+#include <cstring>
+
+namespace country_style {
+
+namespace {
+
+inline uint64_t load8(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+} // namespace
+
+void RleMask::reset(const cv::Rect& area) {
+    bounds = area;
+    runs.clear();
+    row_offsets.assign(std::max(0, area.height) + 1, 0);
+}
+
+int64_t RleMask::pixelCount() const {
+    int64_t count = 0;
+    for (const auto& run : runs) {
+        count += run[1] - run[0];
+    }
+    return count;
+}
+
+void appendRowRuns(const uint8_t* row, int width, int offset, std::vector<cv::Vec2i>& runs) {
+    int x = 0;
+    while (x < width) {
+        while (x + 8 <= width && load8(row + x) == 0) x += 8;
+        while (x < width && row[x] == 0) x++;
+        if (x >= width) break;
+        
+        const int begin = x;
+        while (x + 8 <= width && load8(row + x) == ~0ULL) x += 8;
+        while (x < width && row[x] != 0) x++;
+        runs.push_back(cv::Vec2i(begin + offset, x + offset));
+    }
+}
+
+void encodeMask(const cv::Mat& mask, RleMask& rle, const cv::Point& origin) {
+    rle.bounds = cv::Rect(origin.x, origin.y, mask.cols, mask.rows);
+    rle.runs.clear();
+    rle.row_offsets.resize(mask.rows + 1);
+    for (int y = 0; y < mask.rows; y++) {
+        rle.row_offsets[y] = static_cast<int>(rle.runs.size());
+        appendRowRuns(mask.ptr<uint8_t>(y), mask.cols, 0, rle.runs);
+    }
+    rle.row_offsets[mask.rows] = static_cast<int>(rle.runs.size());
+}
+
+void decodeMask(const RleMask& rle, cv::Mat& mask) {
+    const int rows = std::min(mask.rows, rle.bounds.height);
+    for (int y = 0; y < rows; y++) {
+        uint8_t* row = mask.ptr<uint8_t>(y);
+        int x = 0;
+        for (int r = rle.rowBegin(y); r < rle.rowEnd(y); r++) {
+            const int begin = std::min(rle.runs[r][0], mask.cols);
+            const int end = std::min(rle.runs[r][1], mask.cols);
+            std::memset(row + x, 0, begin - x);
+            std::memset(row + begin, 255, end - begin);
+            x = end;
+        }
+        std::memset(row + x, 0, mask.cols - x);
+    }
+    for (int y = rows; y < mask.rows; y++) {
+        std::memset(mask.ptr<uint8_t>(y), 0, mask.cols);
+    }
+}
+
+void clipMask(RleMask& rle, const cv::Rect& area) {
+    const cv::Rect overlap = rle.bounds & area;
+    if (overlap == rle.bounds) {
+        return;
+    }
+    if (overlap.width <= 0 || overlap.height <= 0) {
+        rle.reset(cv::Rect());
+        return;
+    }
+    
+    // Runs only shrink or disappear, so they are rewritten in place
+    const int dy = overlap.y - rle.bounds.y;
+    const int left = overlap.x - rle.bounds.x;
+    const int right = left + overlap.width;
+    size_t out = 0;
+    for (int y = 0; y < overlap.height; y++) {
+        const int begin = rle.rowBegin(y + dy);
+        const int end = rle.rowEnd(y + dy);
+        rle.row_offsets[y] = static_cast<int>(out);
+        for (int r = begin; r < end; r++) {
+            const int x0 = std::max(rle.runs[r][0], left);
+            const int x1 = std::min(rle.runs[r][1], right);
+            if (x1 > x0) {
+                rle.runs[out++] = cv::Vec2i(x0 - left, x1 - left);
+            }
+        }
+    }
+    rle.row_offsets[overlap.height] = static_cast<int>(out);
+    rle.row_offsets.resize(overlap.height + 1);
+    rle.runs.resize(out);
+    rle.bounds = overlap;
+}
+
+} // namespace country_style
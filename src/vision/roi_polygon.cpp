@@ -0,0 +1,107 @@
+#include "roi_polygon.h"
+#include <algorithm>
+
+namespace country_style {
+
+void rasterizeRoiPolygons(const std::vector<Polygon>& polygons,
+                          const cv::Size& frame_size, RoiSpans& spans) {
+    spans.bounds = cv::Rect();
+    spans.row_offsets.clear();
+    spans.spans.clear();
+    
+    std::vector<std::vector<cv::Point>> outlines;
+    cv::Rect bounds;
+    for (const auto& polygon : polygons) {
+        if (polygon.points.size() < 3) continue;
+        
+        std::vector<cv::Point> outline;
+        outline.reserve(polygon.points.size());
+        for (const auto& p : polygon.points) {
+            outline.push_back(cv::Point(cvRound(p.x), cvRound(p.y)));
+        }
+        cv::Rect box = cv::boundingRect(outline);
+        bounds = bounds.area() > 0 ? (bounds | box) : box;
+        outlines.push_back(outline);
+    }
+    
+    bounds &= cv::Rect(0, 0, frame_size.width, frame_size.height);
+    if (bounds.width <= 0 || bounds.height <= 0) {
+        return;
+    }
+    
+    // Let fillPoly decide pixel coverage, then read the rows back as runs.
+    // One call per polygon: a single call fills even-odd, which would cut
+    // the overlap of two polygons out of the union.
+    cv::Mat coverage = cv::Mat::zeros(bounds.size(), CV_8UC1);
+    for (const auto& outline : outlines) {
+        const cv::Point* points = outline.data();
+        const int count = static_cast<int>(outline.size());
+        cv::fillPoly(coverage, &points, &count, 1, cv::Scalar(255), cv::LINE_8, 0, -bounds.tl());
+    }
+    
+    spans.bounds = bounds;
+    spans.row_offsets.reserve(bounds.height + 1);
+    for (int y = 0; y < bounds.height; y++) {
+        spans.row_offsets.push_back(static_cast<int>(spans.spans.size()));
+        
+        const uint8_t* row = coverage.ptr<uint8_t>(y);
+        int x = 0;
+        while (x < bounds.width) {
+            while (x < bounds.width && !row[x]) x++;
+            int begin = x;
+            while (x < bounds.width && row[x]) x++;
+            if (x > begin) {
+                spans.spans.push_back(cv::Vec2i(begin, x));
+            }
+        }
+    }
+    spans.row_offsets.push_back(static_cast<int>(spans.spans.size()));
+}
+
+void clearOutsideSpans(const RleMask& mask, const RoiSpans& spans, RleMask& clipped) {
+    clipped.reset(mask.bounds);
+    
+    // Intersect the two sorted run lists of each row
+    const int rows = std::min(mask.bounds.height, spans.bounds.height);
+    for (int y = 0; y < rows; y++) {
+        clipped.row_offsets[y] = static_cast<int>(clipped.runs.size());
+        
+        int s = spans.row_offsets[y];
+        const int s_end = spans.row_offsets[y + 1];
+        for (int r = mask.rowBegin(y); r < mask.rowEnd(y); r++) {
+            const cv::Vec2i& run = mask.runs[r];
+            while (s < s_end && spans.spans[s][1] <= run[0]) s++;
+            for (int t = s; t < s_end && spans.spans[t][0] < run[1]; t++) {
+                clipped.runs.push_back(cv::Vec2i(std::max(run[0], spans.spans[t][0]),
+                                                 std::min(run[1], spans.spans[t][1])));
+            }
+        }
+    }
+    for (int y = rows; y <= mask.bounds.height; y++) {
+        clipped.row_offsets[y] = static_cast<int>(clipped.runs.size());
+    }
+}
+
+void cropSpans(const RoiSpans& spans, const cv::Rect& area, RoiSpans& cropped) {
+    cropped.bounds = area;
+    cropped.spans.clear();
+    cropped.row_offsets.assign(1, 0);
+    
+    // Span columns relative to area.x, clipped to its width
+    const int dx = spans.bounds.x - area.x;
+    for (int y = area.y; y < area.y + area.height; y++) {
+        const int sy = y - spans.bounds.y;
+        if (sy >= 0 && sy < spans.bounds.height) {
+            for (int s = spans.row_offsets[sy]; s < spans.row_offsets[sy + 1]; s++) {
+                const int begin = std::max(spans.spans[s][0] + dx, 0);
+                const int end = std::min(spans.spans[s][1] + dx, area.width);
+                if (end > begin) {
+                    cropped.spans.push_back(cv::Vec2i(begin, end));
+                }
+            }
+        }
+        cropped.row_offsets.push_back(static_cast<int>(cropped.spans.size()));
+    }
+}
+
+} // namespace country_style
@@ -13,6 +13,7 @@ RuleEngine::RuleEngine() {
     rules_.max_aspect_ratio = 3.0;
     rules_.expected_count = 0;
     rules_.enforce_count = false;
+    compileRules();
 }
 
 RuleEngine::~RuleEngine() {}
@@ -24,6 +25,25 @@ bool RuleEngine::loadRules(const std::string& config_path) {
 
 void RuleEngine::setRules(const DetectionRules& rules) {
     rules_ = rules;
+    compileRules();
+}
+
+void RuleEngine::compileRules() {
+    // One bit per rule; features are never negative, so a minimum of zero
+    // or less cannot fail and is left out
+    program_.clear();
+    if (rules_.min_area > 0) {
+        program_.addCheck(FeatureColumn::Area, false, rules_.min_area, 1u << 0);
+    }
+    program_.addCheck(FeatureColumn::Area, true, rules_.max_area, 1u << 1);
+    if (rules_.min_circularity > 0) {
+        program_.addCheck(FeatureColumn::Circularity, false, rules_.min_circularity, 1u << 2);
+    }
+    program_.addCheck(FeatureColumn::Circularity, true, rules_.max_circularity, 1u << 3);
+    if (rules_.min_aspect_ratio > 0) {
+        program_.addCheck(FeatureColumn::AspectRatio, false, rules_.min_aspect_ratio, 1u << 4);
+    }
+    program_.addCheck(FeatureColumn::AspectRatio, true, rules_.max_aspect_ratio, 1u << 5);
 }
 
 bool RuleEngine::applyRules(const std::vector<ContourFeatures>& features) {
@@ -72,6 +92,11 @@ bool RuleEngine::validateContour(const ContourFeatures& feature) {
     return true;
 }
 
+void RuleEngine::validateContours(const FeatureColumns& columns,
+                                  std::vector<uint32_t>& rejected) const {
+    program_.evaluate(columns, rejected);
+}
+
 std::string RuleEngine::getValidationMessage() const {
     return validation_message_;
 }
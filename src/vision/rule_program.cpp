@@ -0,0 +1,38 @@
+#include "rule_program.h"
+
+namespace country_style {
+
+void FeatureColumns::resize(size_t count) {
+    for (auto& column : values) {
+        column.resize(count);
+    }
+}
+
+void RuleProgram::clear() {
+    checks_.clear();
+    limits_.clear();
+}
+
+void RuleProgram::addCheck(FeatureColumn column, bool upper, double limit, uint32_t flag) {
+    LimitCheck check;
+    check.column = static_cast<int>(column);
+    check.upper = upper;
+    check.limit = static_cast<float>(limit);
+    check.flag = flag;
+    checks_.push_back(check);
+    limits_.push_back(limit);
+}
+
+void RuleProgram::evaluate(const FeatureColumns& columns, std::vector<uint32_t>& faults) const {
+    const int count = static_cast<int>(columns.size());
+    faults.resize(count);
+    
+    const float* column_data[kFeatureColumnCount];
+    for (int c = 0; c < kFeatureColumnCount; c++) {
+        column_data[c] = columns.values[c].data();
+    }
+    simdKernels().check_limits(column_data, 0, count, checks_.data(),
+                               static_cast<int>(checks_.size()), faults.data());
+}
+
+} // namespace country_style
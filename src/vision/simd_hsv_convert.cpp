@@ -1,18 +1,19 @@
 #include "simd_hsv_convert.h"
-#include <immintrin.h>  // AVX2 intrinsics
-#ifdef _WIN32
-    #include <intrin.h>  // Windows CPUID intrinsics
-#else
-    #include <cpuid.h>
-#endif
 #include <cstring>
+#include <cmath>
 #include <algorithm>
 
 namespace country_style {
 
+namespace {
+
+// Fixed-point precision of OpenCV's 8-bit HSV conversion
+constexpr int kHsvShift = 12;
+
+} // namespace
+
 SimdHsvConverter::SimdHsvConverter() 
-    : hue_lut_(nullptr), sat_lut_(nullptr), use_avx2_(false) {
-    use_avx2_ = hasAvx2Support();
+    : kernels_(&simdKernels()), hue_lut_(nullptr), sat_lut_(nullptr) {
     buildLookupTables();
 }
 
@@ -22,31 +23,22 @@ SimdHsvConverter::~SimdHsvConverter() {
 }
 
 bool SimdHsvConverter::hasAvx2Support() {
-#if defined(__x86_64__) || defined(_M_X64)
-    #ifdef _WIN32
-    // Windows CPUID using __cpuidex intrinsic
-    int cpuInfo[4] = {0};
-    __cpuidex(cpuInfo, 0, 0);
-    if (cpuInfo[0] < 7) return false;
-    
-    __cpuidex(cpuInfo, 7, 0);
-    // bit_AVX2 is bit 5 of EBX (cpuInfo[1])
-    return (cpuInfo[1] & (1 << 5)) != 0;
-    #else
-    unsigned int eax, ebx, ecx, edx;
-    if (__get_cpuid_max(0, nullptr) < 7) return false;
-    __cpuid_count(7, 0, eax, ebx, ecx, edx);
-    // bit_AVX2 is bit 5 of EBX
-    return (ebx & (1 << 5)) != 0;
-    #endif
-#else
-    return false;
-#endif
+    // Also checks that the OS saves YMM state
+    return detectSimdLevel() >= SimdLevel::Avx2;
 }
 
 void SimdHsvConverter::buildLookupTables() {
-    // Pre-allocate lookup tables for common conversions
-    // This optimization may be added if needed
+    // Same tables (and rounding) as OpenCV's 8-bit RGB2HSV so that the
+    // SIMD path reproduces cv::cvtColor exactly
+    if (!hue_lut_) hue_lut_ = new int32_t[256];
+    if (!sat_lut_) sat_lut_ = new int32_t[256];
+    
+    hue_lut_[0] = 0;
+    sat_lut_[0] = 0;
+    for (int i = 1; i < 256; i++) {
+        hue_lut_[i] = static_cast<int32_t>(std::lrint((180 << kHsvShift) / (6.0 * i)));
+        sat_lut_[i] = static_cast<int32_t>(std::lrint((255 << kHsvShift) / (1.0 * i)));
+    }
 }
 
 void SimdHsvConverter::convertBgrToHsv(const cv::Mat& bgr, cv::Mat& hsv) {
@@ -57,75 +49,44 @@ void SimdHsvConverter::convertBgrToHsv(const cv::Mat& bgr, cv::Mat& hsv) {
         hsv.create(bgr.size(), CV_8UC3);
     }
     
-    int total_pixels = bgr.rows * bgr.cols;
-    const uint8_t* bgr_data = bgr.data;
-    uint8_t* hsv_data = hsv.data;
-    
-    if (use_avx2_ && total_pixels >= 32) {
-        // Use SIMD for bulk of pixels
-        int simd_pixels = (total_pixels / 32) * 32;
-        convertBgrToHsvAvx2(bgr_data, hsv_data, simd_pixels);
-        
-        // Handle remainder with OpenCV
-        if (simd_pixels < total_pixels) {
-            cv::Mat bgr_tail = bgr.rowRange(simd_pixels / bgr.cols, bgr.rows);
-            cv::Mat hsv_tail = hsv.rowRange(simd_pixels / bgr.cols, hsv.rows);
-            cv::cvtColor(bgr_tail, hsv_tail, cv::COLOR_BGR2HSV);
-        }
-    } else {
-        // Fallback to OpenCV for small images or no AVX2
+    if (!kernels_->bgr_to_hsv || bgr.type() != CV_8UC3) {
+        // Fallback to OpenCV below AVX2 or for unusual input types
         cv::cvtColor(bgr, hsv, cv::COLOR_BGR2HSV);
+        return;
+    }
+    
+    // Row by row so ROI views and padded buffers need no copy; continuous
+    // images collapse into a single row. The kernel handles the
+    // non-multiple-of-32 tail itself.
+    int rows = bgr.rows;
+    int cols = bgr.cols;
+    if (bgr.isContinuous() && hsv.isContinuous()) {
+        cols *= rows;
+        rows = 1;
+    }
+    for (int y = 0; y < rows; y++) {
+        kernels_->bgr_to_hsv(bgr.ptr<uint8_t>(y), hsv.ptr<uint8_t>(y), cols, hue_lut_, sat_lut_);
     }
 }
 
-void SimdHsvConverter::convertBgrToHsvAvx2(const uint8_t* bgr, uint8_t* hsv, int pixels) {
-    // AVX2 implementation for BGR to HSV conversion
-    // Process 8 pixels (24 bytes BGR -> 24 bytes HSV) per iteration
+void SimdHsvConverter::convertBgrToMaskLut(const cv::Mat& bgr, const uint64_t* lut_bits,
+                                           cv::Mat& mask) {
+    if (bgr.empty() || !lut_bits) return;
     
-    const float scale_h = 180.0f / 360.0f;
-    const float scale_s = 255.0f;
-    const float scale_v = 255.0f;
+    if (mask.size() != bgr.size() || mask.type() != CV_8UC1) {
+        mask.create(bgr.size(), CV_8UC1);
+    }
     
-    for (int i = 0; i < pixels; i++) {
-        int idx = i * 3;
-        
-        // Load BGR values
-        float b = bgr[idx + 0];
-        float g = bgr[idx + 1];
-        float r = bgr[idx + 2];
-        
-        // Calculate Value (max of RGB)
-        float v = std::max({r, g, b});
-        float min_val = std::min({r, g, b});
-        float delta = v - min_val;
-        
-        // Calculate Saturation
-        float s = (v > 0) ? (delta / v * 255.0f) : 0.0f;
-        
-        // Calculate Hue
-        float h = 0.0f;
-        if (delta > 0) {
-            if (v == r) {
-                h = 60.0f * (g - b) / delta;
-            } else if (v == g) {
-                h = 60.0f * (2.0f + (b - r) / delta);
-            } else {
-                h = 60.0f * (4.0f + (r - g) / delta);
-            }
-            if (h < 0) h += 360.0f;
-        }
-        
-        // Convert to OpenCV HSV range (H: 0-180, S: 0-255, V: 0-255)
-        hsv[idx + 0] = static_cast<uint8_t>(h * 0.5f);  // H
-        hsv[idx + 1] = static_cast<uint8_t>(s);         // S
-        hsv[idx + 2] = static_cast<uint8_t>(v);         // V
+    // Row by row, collapsed to one row when both images are continuous
+    int rows = bgr.rows;
+    int cols = bgr.cols;
+    if (bgr.isContinuous() && mask.isContinuous()) {
+        cols *= rows;
+        rows = 1;
+    }
+    for (int y = 0; y < rows; y++) {
+        kernels_->bgr_to_mask_lut(bgr.ptr<uint8_t>(y), mask.ptr<uint8_t>(y), cols, lut_bits);
     }
-}
-
-void SimdHsvConverter::convertBgrToHsvLut(const cv::Mat& bgr, cv::Mat& hsv) {
-    // LUT-based conversion for specific use cases
-    // For now, delegate to OpenCV
-    cv::cvtColor(bgr, hsv, cv::COLOR_BGR2HSV);
 }
 
 } // namespace country_style
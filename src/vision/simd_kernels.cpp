@@ -0,0 +1,195 @@
+#include "simd_kernels.h"
+#include <iostream>
+#include <algorithm>
+#if defined(__x86_64__) || defined(_M_X64)
+    #ifdef _WIN32
+        #include <intrin.h>  // Windows CPUID intrinsics
+        #include <immintrin.h>  // _xgetbv
+    #else
+        #include <cpuid.h>
+    #endif
+#endif
+
+namespace country_style {
+
+namespace {
+
+// Fixed-point precision of OpenCV's 8-bit HSV conversion
+constexpr int kHsvShift = 12;
+
+#if defined(__x86_64__) || defined(_M_X64)
+void cpuid(int leaf, int subleaf, unsigned int regs[4]) {
+    #ifdef _WIN32
+    int info[4];
+    __cpuidex(info, leaf, subleaf);
+    for (int i = 0; i < 4; i++) regs[i] = static_cast<unsigned int>(info[i]);
+    #else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+    #endif
+}
+
+// Register state the OS saves on context switch (XCR0)
+uint64_t osSavedState() {
+    #ifdef _WIN32
+    return _xgetbv(0);
+    #else
+    unsigned int eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+    #endif
+}
+#endif
+
+} // namespace
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Sse41: return "SSE4.1";
+        case SimdLevel::Avx2: return "AVX2";
+        case SimdLevel::Avx512bw: return "AVX-512BW";
+        default: return "Scalar";
+    }
+}
+
+SimdLevel detectSimdLevel() {
+#if defined(__x86_64__) || defined(_M_X64)
+    unsigned int regs[4];
+    cpuid(0, 0, regs);
+    unsigned int max_leaf = regs[0];
+    
+    cpuid(1, 0, regs);
+    bool sse41 = (regs[2] & (1u << 19)) != 0;
+    bool osxsave = (regs[2] & (1u << 27)) != 0;
+    if (!sse41) return SimdLevel::Scalar;
+    if (!osxsave || max_leaf < 7) return SimdLevel::Sse41;
+    
+    // The CPU flags alone are not enough: the OS must also save the wider
+    // registers, otherwise AVX instructions fault
+    uint64_t xcr0 = osSavedState();
+    bool ymm_saved = (xcr0 & 0x6) == 0x6;
+    bool zmm_saved = (xcr0 & 0xE6) == 0xE6;
+    
+    cpuid(7, 0, regs);
+    bool avx2 = (regs[1] & (1u << 5)) != 0;
+    bool avx512f = (regs[1] & (1u << 16)) != 0;
+    bool avx512bw = (regs[1] & (1u << 30)) != 0;
+    
+    if (avx2 && avx512f && avx512bw && zmm_saved) return SimdLevel::Avx512bw;
+    if (avx2 && ymm_saved) return SimdLevel::Avx2;
+    return SimdLevel::Sse41;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+const SimdKernels& simdKernels() {
+    static const SimdKernels* selected = [] {
+        // Walk down from the best level the CPU supports to one this
+        // build actually contains
+        SimdLevel cpu_level = detectSimdLevel();
+        const SimdKernels* kernels = nullptr;
+        if (!kernels && cpu_level >= SimdLevel::Avx512bw) kernels = avx512Kernels();
+        if (!kernels && cpu_level >= SimdLevel::Avx2) kernels = avx2Kernels();
+        if (!kernels && cpu_level >= SimdLevel::Sse41) kernels = sse41Kernels();
+        if (!kernels) kernels = scalarKernels();
+        
+        std::cout << "Vision kernels: " << simdLevelName(kernels->level)
+                  << " (CPU supports " << simdLevelName(cpu_level) << ")" << std::endl;
+        return kernels;
+    }();
+    return *selected;
+}
+
+void bgrToHsvScalar(const uint8_t* bgr, uint8_t* hsv, int pixels,
+                    const int32_t* hue_lut, const int32_t* sat_lut) {
+    const int round = 1 << (kHsvShift - 1);
+    
+    for (int i = 0; i < pixels; i++) {
+        int idx = i * 3;
+        int b = bgr[idx + 0];
+        int g = bgr[idx + 1];
+        int r = bgr[idx + 2];
+        
+        int v = std::max({b, g, r});
+        int vmin = std::min({b, g, r});
+        int diff = v - vmin;
+        
+        int s = (diff * sat_lut[v] + round) >> kHsvShift;
+        
+        int h;
+        if (v == r) {
+            h = g - b;
+        } else if (v == g) {
+            h = b - r + 2 * diff;
+        } else {
+            h = r - g + 4 * diff;
+        }
+        h = (h * hue_lut[diff] + round) >> kHsvShift;
+        if (h < 0) h += 180;
+        
+        hsv[idx + 0] = static_cast<uint8_t>(h);
+        hsv[idx + 1] = static_cast<uint8_t>(s);
+        hsv[idx + 2] = static_cast<uint8_t>(v);
+    }
+}
+
+void bgrToMaskLutScalar(const uint8_t* bgr, uint8_t* mask, int pixels,
+                        const uint64_t* lut_bits) {
+    for (int i = 0; i < pixels; i++) {
+        uint32_t color = bgr[i * 3] | (bgr[i * 3 + 1] << 8) | (bgr[i * 3 + 2] << 16);
+        uint64_t bit = (lut_bits[color >> 6] >> (color & 63)) & 1;
+        mask[i] = static_cast<uint8_t>(0 - bit);
+    }
+}
+
+void inRangeScalar(const uint8_t* src, uint8_t* mask, int pixels,
+                   const ColorBox* boxes, int box_count) {
+    for (int i = 0; i < pixels; i++) {
+        const uint8_t* p = src + i * 3;
+        bool in_range = false;
+        for (int b = 0; b < box_count && !in_range; b++) {
+            const uint8_t* lower = boxes[b].lower;
+            const uint8_t* upper = boxes[b].upper;
+            bool hue_in = lower[0] > upper[0] ? (p[0] >= lower[0] || p[0] <= upper[0])
+                                              : (p[0] >= lower[0] && p[0] <= upper[0]);
+            in_range = (hue_in &&
+                        p[1] >= lower[1] && p[1] <= upper[1] &&
+                        p[2] >= lower[2] && p[2] <= upper[2]);
+        }
+        mask[i] = in_range ? 255 : 0;
+    }
+}
+
+uint64_t sumAbsDiffScalar(const uint8_t* a, const uint8_t* b, int bytes) {
+    uint64_t sum = 0;
+    for (int i = 0; i < bytes; i++) {
+        sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+    }
+    return sum;
+}
+
+void checkLimitsScalar(const float* const* columns, int first, int count,
+                       const LimitCheck* checks, int check_count, uint32_t* faults) {
+    for (int i = first; i < count; i++) {
+        uint32_t flags = 0;
+        for (int c = 0; c < check_count; c++) {
+            const LimitCheck& check = checks[c];
+            const float value = columns[check.column][i];
+            if (check.upper ? value > check.limit : value < check.limit) {
+                flags |= check.flag;
+            }
+        }
+        faults[i] = flags;
+    }
+}
+
+const SimdKernels* scalarKernels() {
+    // HSV goes through cv::cvtColor, which beats a per-pixel loop
+    static const SimdKernels kernels = {
+        SimdLevel::Scalar, nullptr, bgrToMaskLutScalar, inRangeScalar, sumAbsDiffScalar,
+        checkLimitsScalar
+    };
+    return &kernels;
+}
+
+} // namespace country_style
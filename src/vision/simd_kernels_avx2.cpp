@@ -0,0 +1,247 @@
+// AVX2 kernels. Built with -mavx2 only; see simd_kernels.h.
+//
+// Keep library templates (std::min, containers, ...) out of the per-ISA
+// files: their out-of-line copies are shared with the rest of the program
+// and the linker may keep the one compiled with wider instructions.
+#include "simd_kernels.h"
+
+#ifdef __AVX2__
+#include "simd_interleave.h"
+#include <immintrin.h>
+
+namespace country_style {
+
+namespace {
+
+// Fixed-point precision of OpenCV's 8-bit HSV conversion
+constexpr int kHsvShift = 12;
+
+// Fixed-point hue and saturation for 8 pixels held in 32-bit lanes
+inline void hueSat8(__m256i h_num, __m256i diff, __m256i v,
+                    const int32_t* hue_lut, const int32_t* sat_lut,
+                    __m256i& h, __m256i& s) {
+    const __m256i round = _mm256_set1_epi32(1 << (kHsvShift - 1));
+    const __m256i hue_range = _mm256_set1_epi32(180);
+    
+    __m256i hdiv = _mm256_i32gather_epi32(reinterpret_cast<const int*>(hue_lut), diff, 4);
+    __m256i sdiv = _mm256_i32gather_epi32(reinterpret_cast<const int*>(sat_lut), v, 4);
+    
+    h = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(h_num, hdiv), round), kHsvShift);
+    h = _mm256_add_epi32(h, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), h), hue_range));
+    s = _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(diff, sdiv), round), kHsvShift);
+}
+
+// Hue and saturation for 16 pixels held in 16-bit lanes
+inline void hueSat16(__m256i b, __m256i g, __m256i r, __m256i v, __m256i diff,
+                     const int32_t* hue_lut, const int32_t* sat_lut,
+                     __m256i& h, __m256i& s) {
+    // Hue numerator of the max-channel sector, as in OpenCV:
+    // v == r: g - b, v == g: b - r + 2*diff, otherwise r - g + 4*diff
+    __m256i vr = _mm256_cmpeq_epi16(v, r);
+    __m256i vg = _mm256_cmpeq_epi16(v, g);
+    __m256i diff2 = _mm256_slli_epi16(diff, 1);
+    __m256i h_r = _mm256_sub_epi16(g, b);
+    __m256i h_g = _mm256_add_epi16(_mm256_sub_epi16(b, r), diff2);
+    __m256i h_b = _mm256_add_epi16(_mm256_sub_epi16(r, g), _mm256_slli_epi16(diff2, 1));
+    __m256i h_num = _mm256_blendv_epi8(_mm256_blendv_epi8(h_b, h_g, vg), h_r, vr);
+    
+    __m256i h0, h1, s0, s1;
+    hueSat8(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(h_num)),
+            _mm256_cvtepu16_epi32(_mm256_castsi256_si128(diff)),
+            _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v)),
+            hue_lut, sat_lut, h0, s0);
+    hueSat8(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(h_num, 1)),
+            _mm256_cvtepu16_epi32(_mm256_extracti128_si256(diff, 1)),
+            _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1)),
+            hue_lut, sat_lut, h1, s1);
+    
+    // packs works per 128-bit lane; restore pixel order
+    h = _mm256_permute4x64_epi64(_mm256_packs_epi32(h0, h1), 0xD8);
+    s = _mm256_permute4x64_epi64(_mm256_packs_epi32(s0, s1), 0xD8);
+}
+
+inline __m256i widenLo(__m256i x) { return _mm256_cvtepu8_epi16(_mm256_castsi256_si128(x)); }
+inline __m256i widenHi(__m256i x) { return _mm256_cvtepu8_epi16(_mm256_extracti128_si256(x, 1)); }
+
+void bgrToHsvAvx2(const uint8_t* bgr, uint8_t* hsv, int pixels,
+                  const int32_t* hue_lut, const int32_t* sat_lut) {
+    // Process 32 pixels (96 bytes BGR -> 96 bytes HSV) per iteration
+    int simd_pixels = (pixels / 32) * 32;
+    
+    for (int i = 0; i < simd_pixels; i += 32) {
+        __m256i b, g, r;
+        loadDeinterleave32(bgr + i * 3, b, g, r);
+        
+        __m256i v = _mm256_max_epu8(_mm256_max_epu8(b, g), r);
+        __m256i vmin = _mm256_min_epu8(_mm256_min_epu8(b, g), r);
+        __m256i diff = _mm256_sub_epi8(v, vmin);
+        
+        __m256i h_lo, s_lo, h_hi, s_hi;
+        hueSat16(widenLo(b), widenLo(g), widenLo(r), widenLo(v), widenLo(diff),
+                 hue_lut, sat_lut, h_lo, s_lo);
+        hueSat16(widenHi(b), widenHi(g), widenHi(r), widenHi(v), widenHi(diff),
+                 hue_lut, sat_lut, h_hi, s_hi);
+        
+        __m256i h = _mm256_permute4x64_epi64(_mm256_packus_epi16(h_lo, h_hi), 0xD8);
+        __m256i s = _mm256_permute4x64_epi64(_mm256_packus_epi16(s_lo, s_hi), 0xD8);
+        
+        storeInterleave32(hsv + i * 3, h, s, v);
+    }
+    
+    // Handle remainder
+    bgrToHsvScalar(bgr + simd_pixels * 3, hsv + simd_pixels * 3,
+                   pixels - simd_pixels, hue_lut, sat_lut);
+}
+
+void bgrToMaskLutAvx2(const uint8_t* bgr, uint8_t* mask, int pixels,
+                      const uint64_t* lut_bits) {
+    const int* lut_words = reinterpret_cast<const int*>(lut_bits);
+    
+    // Spread 8 packed pixels (24 bytes) into 32-bit lanes: b | g << 8 | r << 16
+    const __m256i spread = _mm256_setr_epi32(0, 1, 2, 3, 2, 3, 4, 5);
+    const __m256i to_index = _mm256_setr_epi8(
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+        4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15, -1);
+    const __m256i low5 = _mm256_set1_epi32(31);
+    const __m256i one = _mm256_set1_epi32(1);
+    
+    // Each iteration loads 32 bytes, so stop while 11+ pixels remain
+    int i = 0;
+    for (; i + 11 <= pixels; i += 8) {
+        __m256i raw = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bgr + i * 3));
+        __m256i index = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(raw, spread), to_index);
+        
+        __m256i words = _mm256_i32gather_epi32(lut_words, _mm256_srli_epi32(index, 5), 4);
+        __m256i bits = _mm256_and_si256(
+            _mm256_srlv_epi32(words, _mm256_and_si256(index, low5)), one);
+        bits = _mm256_sub_epi32(_mm256_setzero_si256(), bits);
+        
+        __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(bits),
+                                         _mm256_extracti128_si256(bits, 1));
+        packed = _mm_packs_epi16(packed, packed);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(mask + i), packed);
+    }
+    
+    bgrToMaskLutScalar(bgr + i * 3, mask + i, pixels - i, lut_bits);
+}
+
+// Broadcast bounds of one color box
+struct BoxVectors {
+    __m256i lo[3];
+    __m256i hi[3];
+    __m256i hue_flip;
+};
+
+inline void broadcastBox(const ColorBox& box, BoxVectors& v) {
+    // A wrapped hue range is tested as its complementary gap, then inverted
+    const bool hue_wraps = box.lower[0] > box.upper[0];
+    const uint8_t h_lo = hue_wraps ? static_cast<uint8_t>(box.upper[0] + 1) : box.lower[0];
+    const uint8_t h_hi = hue_wraps ? static_cast<uint8_t>(box.lower[0] - 1) : box.upper[0];
+    
+    v.lo[0] = _mm256_set1_epi8(static_cast<char>(h_lo));
+    v.hi[0] = _mm256_set1_epi8(static_cast<char>(h_hi));
+    for (int c = 1; c < 3; c++) {
+        v.lo[c] = _mm256_set1_epi8(static_cast<char>(box.lower[c]));
+        v.hi[c] = _mm256_set1_epi8(static_cast<char>(box.upper[c]));
+    }
+    v.hue_flip = _mm256_set1_epi8(hue_wraps ? -1 : 0);
+}
+
+void inRangeAvx2(const uint8_t* src, uint8_t* mask, int pixels,
+                 const ColorBox* boxes, int box_count) {
+    // Scalar head until the mask pointer is 32-byte aligned
+    int head = static_cast<int>((32 - (reinterpret_cast<uintptr_t>(mask) & 31)) & 31);
+    if (head > pixels) head = pixels;
+    inRangeScalar(src, mask, head, boxes, box_count);
+    
+    BoxVectors box_vectors[kMaxColorBoxes];
+    if (box_count > kMaxColorBoxes) box_count = kMaxColorBoxes;
+    for (int b = 0; b < box_count; b++) {
+        broadcastBox(boxes[b], box_vectors[b]);
+    }
+    
+    // Process 32 pixels (96 bytes -> 32 mask bytes) per iteration; the
+    // pixels are deinterleaved once and tested against every box
+    int i = head;
+    for (; i + 32 <= pixels; i += 32) {
+        __m256i c0, c1, c2;
+        loadDeinterleave32(src + i * 3, c0, c1, c2);
+        
+        __m256i inside = _mm256_setzero_si256();
+        for (int b = 0; b < box_count; b++) {
+            const BoxVectors& v = box_vectors[b];
+            
+            // Unsigned saturating differences are zero exactly when lo <= x <= hi
+            __m256i hue_out = _mm256_or_si256(_mm256_subs_epu8(v.lo[0], c0), _mm256_subs_epu8(c0, v.hi[0]));
+            __m256i sv_out = _mm256_or_si256(
+                _mm256_or_si256(_mm256_subs_epu8(v.lo[1], c1), _mm256_subs_epu8(c1, v.hi[1])),
+                _mm256_or_si256(_mm256_subs_epu8(v.lo[2], c2), _mm256_subs_epu8(c2, v.hi[2])));
+        
+            __m256i hue_in = _mm256_xor_si256(_mm256_cmpeq_epi8(hue_out, _mm256_setzero_si256()), v.hue_flip);
+            __m256i sv_in = _mm256_cmpeq_epi8(sv_out, _mm256_setzero_si256());
+            inside = _mm256_or_si256(inside, _mm256_and_si256(hue_in, sv_in));
+        }
+        
+        _mm256_store_si256(reinterpret_cast<__m256i*>(mask + i), inside);
+    }
+    
+    // Handle remainder
+    inRangeScalar(src + i * 3, mask + i, pixels - i, boxes, box_count);
+}
+
+uint64_t sumAbsDiffAvx2(const uint8_t* a, const uint8_t* b, int bytes) {
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(va, vb));
+    }
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    uint64_t sum = static_cast<uint64_t>(_mm_cvtsi128_si64(half)) +
+                   static_cast<uint64_t>(_mm_extract_epi64(half, 1));
+    return sum + sumAbsDiffScalar(a + i, b + i, bytes - i);
+}
+
+void checkLimitsAvx2(const float* const* columns, int first, int count,
+                     const LimitCheck* checks, int check_count, uint32_t* faults) {
+    // 8 detections per iteration: each check is one compare, and its flag
+    // is masked into the lanes that failed it
+    int i = first;
+    for (; i + 8 <= count; i += 8) {
+        __m256i flags = _mm256_setzero_si256();
+        for (int c = 0; c < check_count; c++) {
+            const LimitCheck& check = checks[c];
+            const __m256 values = _mm256_loadu_ps(columns[check.column] + i);
+            const __m256 limit = _mm256_set1_ps(check.limit);
+            const __m256i flag = _mm256_set1_epi32(static_cast<int>(check.flag));
+            const __m256 failed = check.upper ? _mm256_cmp_ps(values, limit, _CMP_GT_OQ)
+                                              : _mm256_cmp_ps(values, limit, _CMP_LT_OQ);
+            flags = _mm256_or_si256(flags, _mm256_and_si256(_mm256_castps_si256(failed), flag));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(faults + i), flags);
+    }
+    
+    // Handle remainder
+    checkLimitsScalar(columns, i, count, checks, check_count, faults);
+}
+
+} // namespace
+
+const SimdKernels* avx2Kernels() {
+    static const SimdKernels kernels = {
+        SimdLevel::Avx2, bgrToHsvAvx2, bgrToMaskLutAvx2, inRangeAvx2, sumAbsDiffAvx2,
+        checkLimitsAvx2
+    };
+    return &kernels;
+}
+
+} // namespace country_style
+
+#else
+
+namespace country_style {
+const SimdKernels* avx2Kernels() { return nullptr; }
+} // namespace country_style
+
+#endif
@@ -0,0 +1,116 @@
+// AVX-512BW kernels. Built with -mavx512f -mavx512bw; see simd_kernels.h.
+//
+// Keep library templates (std::min, containers, ...) out of the per-ISA
+// files: their out-of-line copies are shared with the rest of the program
+// and the linker may keep the one compiled with wider instructions.
+#include "simd_kernels.h"
+
+#if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX2__)
+#include "simd_interleave.h"
+#include <immintrin.h>
+
+namespace country_style {
+
+namespace {
+
+// Broadcast bounds of one color box
+struct BoxVectors {
+    __m512i lo[3];
+    __m512i hi[3];
+    __mmask64 hue_flip;
+};
+
+inline void broadcastBox(const ColorBox& box, BoxVectors& v) {
+    // A wrapped hue range is tested as its complementary gap, then inverted
+    const bool hue_wraps = box.lower[0] > box.upper[0];
+    const uint8_t h_lo = hue_wraps ? static_cast<uint8_t>(box.upper[0] + 1) : box.lower[0];
+    const uint8_t h_hi = hue_wraps ? static_cast<uint8_t>(box.lower[0] - 1) : box.upper[0];
+    
+    v.lo[0] = _mm512_set1_epi8(static_cast<char>(h_lo));
+    v.hi[0] = _mm512_set1_epi8(static_cast<char>(h_hi));
+    for (int c = 1; c < 3; c++) {
+        v.lo[c] = _mm512_set1_epi8(static_cast<char>(box.lower[c]));
+        v.hi[c] = _mm512_set1_epi8(static_cast<char>(box.upper[c]));
+    }
+    v.hue_flip = hue_wraps ? ~static_cast<__mmask64>(0) : 0;
+}
+
+void inRangeAvx512(const uint8_t* src, uint8_t* mask, int pixels,
+                   const ColorBox* boxes, int box_count) {
+    // Scalar head until the mask pointer is 64-byte aligned
+    int head = static_cast<int>((64 - (reinterpret_cast<uintptr_t>(mask) & 63)) & 63);
+    if (head > pixels) head = pixels;
+    inRangeScalar(src, mask, head, boxes, box_count);
+    
+    BoxVectors box_vectors[kMaxColorBoxes];
+    if (box_count > kMaxColorBoxes) box_count = kMaxColorBoxes;
+    for (int b = 0; b < box_count; b++) {
+        broadcastBox(boxes[b], box_vectors[b]);
+    }
+    
+    // Process 64 pixels (two 32-pixel deinterleaves) per iteration
+    int i = head;
+    for (; i + 64 <= pixels; i += 64) {
+        __m256i a0, a1, a2, b0, b1, b2;
+        loadDeinterleave32(src + i * 3, a0, a1, a2);
+        loadDeinterleave32(src + i * 3 + 96, b0, b1, b2);
+        
+        __m512i c0 = _mm512_inserti64x4(_mm512_castsi256_si512(a0), b0, 1);
+        __m512i c1 = _mm512_inserti64x4(_mm512_castsi256_si512(a1), b1, 1);
+        __m512i c2 = _mm512_inserti64x4(_mm512_castsi256_si512(a2), b2, 1);
+        
+        // Unsigned compares straight into 64-bit lane masks
+        __mmask64 inside = 0;
+        for (int b = 0; b < box_count; b++) {
+            const BoxVectors& v = box_vectors[b];
+            __mmask64 hue_in = (_mm512_cmpge_epu8_mask(c0, v.lo[0]) &
+                                _mm512_cmple_epu8_mask(c0, v.hi[0])) ^ v.hue_flip;
+            inside |= hue_in &
+                      _mm512_cmpge_epu8_mask(c1, v.lo[1]) & _mm512_cmple_epu8_mask(c1, v.hi[1]) &
+                      _mm512_cmpge_epu8_mask(c2, v.lo[2]) & _mm512_cmple_epu8_mask(c2, v.hi[2]);
+        }
+        
+        _mm512_store_si512(reinterpret_cast<__m512i*>(mask + i), _mm512_movm_epi8(inside));
+    }
+    
+    // Handle remainder
+    inRangeScalar(src + i * 3, mask + i, pixels - i, boxes, box_count);
+}
+
+uint64_t sumAbsDiffAvx512(const uint8_t* a, const uint8_t* b, int bytes) {
+    __m512i acc = _mm512_setzero_si512();
+    int i = 0;
+    for (; i + 64 <= bytes; i += 64) {
+        __m512i va = _mm512_loadu_si512(a + i);
+        __m512i vb = _mm512_loadu_si512(b + i);
+        acc = _mm512_add_epi64(acc, _mm512_sad_epu8(va, vb));
+    }
+    uint64_t sum = static_cast<uint64_t>(_mm512_reduce_add_epi64(acc));
+    return sum + sumAbsDiffScalar(a + i, b + i, bytes - i);
+}
+
+} // namespace
+
+const SimdKernels* avx512Kernels() {
+    // HSV conversion and the color table lookup are gather-bound and gain
+    // nothing from wider vectors; reuse the AVX2 versions. So do the rule
+    // checks: a frame holds a few dozen detections at most.
+    const SimdKernels* avx2 = avx2Kernels();
+    if (!avx2) return nullptr;
+    
+    static const SimdKernels kernels = {
+        SimdLevel::Avx512bw, avx2->bgr_to_hsv, avx2->bgr_to_mask_lut, inRangeAvx512,
+        sumAbsDiffAvx512, avx2->check_limits
+    };
+    return &kernels;
+}
+
+} // namespace country_style
+
+#else
+
+namespace country_style {
+const SimdKernels* avx512Kernels() { return nullptr; }
+} // namespace country_style
+
+#endif
@@ -0,0 +1,151 @@
+// SSE4.1 kernels. Built with -msse4.1 only; see simd_kernels.h.
+//
+// Keep library templates (std::min, containers, ...) out of the per-ISA
+// files: their out-of-line copies are shared with the rest of the program
+// and the linker may keep the one compiled with wider instructions.
+#include "simd_kernels.h"
+
+#if defined(__SSE4_1__) || (defined(_MSC_VER) && defined(_M_X64))
+#include <immintrin.h>
+
+namespace country_style {
+
+namespace {
+
+// Split 16 packed 3-channel pixels (48 bytes) into one register per channel
+inline void loadDeinterleave16(const uint8_t* src, __m128i& c0, __m128i& c1, __m128i& c2) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+    const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+    
+    c0 = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(a, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+    c1 = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(a, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+    c2 = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(a, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+// Broadcast bounds of one color box
+struct BoxVectors {
+    __m128i lo[3];
+    __m128i hi[3];
+    __m128i hue_flip;
+};
+
+inline void broadcastBox(const ColorBox& box, BoxVectors& v) {
+    // A wrapped hue range is tested as its complementary gap, then inverted
+    const bool hue_wraps = box.lower[0] > box.upper[0];
+    const uint8_t h_lo = hue_wraps ? static_cast<uint8_t>(box.upper[0] + 1) : box.lower[0];
+    const uint8_t h_hi = hue_wraps ? static_cast<uint8_t>(box.lower[0] - 1) : box.upper[0];
+    
+    v.lo[0] = _mm_set1_epi8(static_cast<char>(h_lo));
+    v.hi[0] = _mm_set1_epi8(static_cast<char>(h_hi));
+    for (int c = 1; c < 3; c++) {
+        v.lo[c] = _mm_set1_epi8(static_cast<char>(box.lower[c]));
+        v.hi[c] = _mm_set1_epi8(static_cast<char>(box.upper[c]));
+    }
+    v.hue_flip = _mm_set1_epi8(hue_wraps ? -1 : 0);
+}
+
+void inRangeSse41(const uint8_t* src, uint8_t* mask, int pixels,
+                  const ColorBox* boxes, int box_count) {
+    // Scalar head until the mask pointer is 16-byte aligned
+    int head = static_cast<int>((16 - (reinterpret_cast<uintptr_t>(mask) & 15)) & 15);
+    if (head > pixels) head = pixels;
+    inRangeScalar(src, mask, head, boxes, box_count);
+    
+    BoxVectors box_vectors[kMaxColorBoxes];
+    if (box_count > kMaxColorBoxes) box_count = kMaxColorBoxes;
+    for (int b = 0; b < box_count; b++) {
+        broadcastBox(boxes[b], box_vectors[b]);
+    }
+    
+    int i = head;
+    for (; i + 16 <= pixels; i += 16) {
+        __m128i c0, c1, c2;
+        loadDeinterleave16(src + i * 3, c0, c1, c2);
+        
+        __m128i inside = _mm_setzero_si128();
+        for (int b = 0; b < box_count; b++) {
+            const BoxVectors& v = box_vectors[b];
+            
+            // Unsigned saturating differences are zero exactly when lo <= x <= hi
+            __m128i hue_out = _mm_or_si128(_mm_subs_epu8(v.lo[0], c0), _mm_subs_epu8(c0, v.hi[0]));
+            __m128i sv_out = _mm_or_si128(
+                _mm_or_si128(_mm_subs_epu8(v.lo[1], c1), _mm_subs_epu8(c1, v.hi[1])),
+                _mm_or_si128(_mm_subs_epu8(v.lo[2], c2), _mm_subs_epu8(c2, v.hi[2])));
+        
+            __m128i hue_in = _mm_xor_si128(_mm_cmpeq_epi8(hue_out, _mm_setzero_si128()), v.hue_flip);
+            __m128i sv_in = _mm_cmpeq_epi8(sv_out, _mm_setzero_si128());
+            inside = _mm_or_si128(inside, _mm_and_si128(hue_in, sv_in));
+        }
+    
+        _mm_store_si128(reinterpret_cast<__m128i*>(mask + i), inside);
+    }
+    
+    inRangeScalar(src + i * 3, mask + i, pixels - i, boxes, box_count);
+}
+
+// psadbw sums |a - b| of 8 bytes into each 64-bit half
+uint64_t sumAbsDiffSse41(const uint8_t* a, const uint8_t* b, int bytes) {
+    __m128i acc = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+    }
+    uint64_t sum = static_cast<uint64_t>(_mm_cvtsi128_si64(acc)) +
+                   static_cast<uint64_t>(_mm_extract_epi64(acc, 1));
+    return sum + sumAbsDiffScalar(a + i, b + i, bytes - i);
+}
+
+// 4 detections per iteration, as in the AVX2 version
+void checkLimitsSse41(const float* const* columns, int first, int count,
+                      const LimitCheck* checks, int check_count, uint32_t* faults) {
+    int i = first;
+    for (; i + 4 <= count; i += 4) {
+        __m128i flags = _mm_setzero_si128();
+        for (int c = 0; c < check_count; c++) {
+            const LimitCheck& check = checks[c];
+            const __m128 values = _mm_loadu_ps(columns[check.column] + i);
+            const __m128 limit = _mm_set1_ps(check.limit);
+            const __m128i flag = _mm_set1_epi32(static_cast<int>(check.flag));
+            const __m128 failed = check.upper ? _mm_cmpgt_ps(values, limit)
+                                              : _mm_cmplt_ps(values, limit);
+            flags = _mm_or_si128(flags, _mm_and_si128(_mm_castps_si128(failed), flag));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(faults + i), flags);
+    }
+    
+    checkLimitsScalar(columns, i, count, checks, check_count, faults);
+}
+
+} // namespace
+
+const SimdKernels* sse41Kernels() {
+    // No gather at this level: HSV uses cv::cvtColor and the color table
+    // lookup stays scalar
+    static const SimdKernels kernels = {
+        SimdLevel::Sse41, nullptr, bgrToMaskLutScalar, inRangeSse41, sumAbsDiffSse41,
+        checkLimitsSse41
+    };
+    return &kernels;
+}
+
+} // namespace country_style
+
+#else
+
+namespace country_style {
+const SimdKernels* sse41Kernels() { return nullptr; }
+} // namespace country_style
+
+#endif
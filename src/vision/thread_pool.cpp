@@ -0,0 +1,80 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+namespace country_style {
+
+ThreadPool::ThreadPool(int threads)
+    : task_(nullptr), count_(0), next_(0), active_(0), generation_(0), stop_(false) {
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int w = 1; w < threads; w++) {
+        workers_.emplace_back(&ThreadPool::workerLoop, this, w);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    start_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int, int)>& task) {
+    if (count <= 0) return;
+    
+    // Nothing to share: run on the calling thread
+    if (workers_.empty() || count == 1) {
+        for (int i = 0; i < count; i++) task(i, 0);
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        count_ = count;
+        next_ = 0;
+        active_ = static_cast<int>(workers_.size());
+        generation_++;
+    }
+    start_cv_.notify_all();
+    
+    runTasks(0);
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return active_ == 0; });
+    task_ = nullptr;
+}
+
+void ThreadPool::workerLoop(int worker) {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_cv_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_) return;
+            seen = generation_;
+        }
+        
+        runTasks(worker);
+        
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--active_ == 0) {
+            done_cv_.notify_one();
+        }
+    }
+}
+
+void ThreadPool::runTasks(int worker) {
+    // Tasks are handed out one at a time, so uneven bands balance out
+    int index;
+    while ((index = next_.fetch_add(1)) < count_) {
+        (*task_)(index, worker);
+    }
+}
+
+} // namespace country_style
@@ -1,11 +1,261 @@
 #include "vision_pipeline.h"
 #include "config_manager.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 
 namespace country_style {
 
+namespace {
+
+// Fault bits behind each aggregate flag
+const uint32_t kUndersizedFaults = faultBit(DetectionFault::AreaTooSmall) |
+                                   faultBit(DetectionFault::WidthTooSmall) |
+                                   faultBit(DetectionFault::LengthTooSmall);
+const uint32_t kOversizedFaults = faultBit(DetectionFault::AreaTooLarge) |
+                                  faultBit(DetectionFault::WidthTooLarge) |
+                                  faultBit(DetectionFault::LengthTooLarge);
+const uint32_t kShapeFaults = faultBit(DetectionFault::AspectRatioTooLow) |
+                              faultBit(DetectionFault::AspectRatioTooHigh) |
+                              faultBit(DetectionFault::CircularityTooLow) |
+                              faultBit(DetectionFault::CircularityTooHigh);
+
+// Compile the size and shape limits of a threshold set, respecting its
+// enable flags, into one check per limit flagged with its fault bit
+void compileThresholds(const QualityThresholds& t, RuleProgram& program) {
+    program.clear();
+    auto check = [&program](double limit, FeatureColumn column, bool upper, DetectionFault fault) {
+        if (limit > 0) program.addCheck(column, upper, limit, faultBit(fault));
+    };
+    
+    if (t.enable_area_check) {
+        check(t.min_area, FeatureColumn::Area, false, DetectionFault::AreaTooSmall);
+        check(t.max_area, FeatureColumn::Area, true, DetectionFault::AreaTooLarge);
+    }
+    if (t.enable_width_check) {
+        check(t.min_width, FeatureColumn::Width, false, DetectionFault::WidthTooSmall);
+        check(t.max_width, FeatureColumn::Width, true, DetectionFault::WidthTooLarge);
+    }
+    if (t.enable_height_check) {
+        check(t.min_height, FeatureColumn::Height, false, DetectionFault::LengthTooSmall);
+        check(t.max_height, FeatureColumn::Height, true, DetectionFault::LengthTooLarge);
+    }
+    if (t.enable_aspect_ratio_check) {
+        check(t.min_aspect_ratio, FeatureColumn::AspectRatio, false,
+              DetectionFault::AspectRatioTooLow);
+        check(t.max_aspect_ratio, FeatureColumn::AspectRatio, true,
+              DetectionFault::AspectRatioTooHigh);
+    }
+    if (t.enable_circularity_check) {
+        check(t.min_circularity, FeatureColumn::Circularity, false,
+              DetectionFault::CircularityTooLow);
+        check(t.max_circularity, FeatureColumn::Circularity, true,
+              DetectionFault::CircularityTooHigh);
+    }
+}
+    
+// Set a detection's faults from the checks of a compiled threshold set,
+// with the limit behind each
+void applyFaults(DetectionMeasurement& meas, uint32_t faults, const RuleProgram& program) {
+    meas.faults = faults;
+    meas.meets_specs = faults == 0;
+    if (faults == 0) return;
+    
+    const std::vector<LimitCheck>& checks = program.checks();
+    for (size_t c = 0; c < checks.size(); c++) {
+        if (!(faults & checks[c].flag)) continue;
+        int fault = 0;
+        while (!(checks[c].flag & (1u << fault))) fault++;
+        meas.fault_limits[fault] = program.limit(c);
+    }
+}
+
+// Fill the fault flags and pass/fail of a frame or lane verdict
+// (DetectionResult or LaneResult) from its count and the detections that
+// belong to it (lane index, -1 for those outside every lane). Returns the
+// number of faults: the count fault plus one per failed detection.
+template <typename Verdict>
+int judgeDetections(Verdict& verdict, int count,
+                    const std::vector<DetectionMeasurement>& measurements,
+                    int lane, const QualityThresholds& t) {
+    verdict.dough_count = count;
+    
+    // Initialize fault flags
+    verdict.fault_count_low = false;
+    verdict.fault_count_high = false;
+    verdict.count_limit = -1;
+    verdict.count_expected = false;
+    verdict.fault_undersized = false;
+    verdict.fault_oversized = false;
+    verdict.fault_shape_defect = false;
+    
+    // Count validation (if enabled)
+    if (t.enable_count_check) {
+        if (t.enforce_exact_count && count != t.expected_count) {
+            verdict.fault_count_low = count < t.expected_count;
+            verdict.fault_count_high = count > t.expected_count;
+            verdict.count_limit = t.expected_count;
+            verdict.count_expected = true;
+        } else if (t.min_count > 0 && count < t.min_count) {
+            verdict.fault_count_low = true;
+            verdict.count_limit = t.min_count;
+        } else if (t.max_count > 0 && count > t.max_count) {
+            verdict.fault_count_high = true;
+            verdict.count_limit = t.max_count;
+        }
+    }
+    int faults = verdict.count_limit >= 0 ? 1 : 0;
+    
+    // Individual detection faults
+    for (const auto& meas : measurements) {
+        if (meas.lane != lane || meas.meets_specs) continue;
+        
+        verdict.fault_undersized |= (meas.faults & kUndersizedFaults) != 0;
+        verdict.fault_oversized |= (meas.faults & kOversizedFaults) != 0;
+        verdict.fault_shape_defect |= (meas.faults & kShapeFaults) != 0;
+        faults++;
+    }
+    
+    // Overall validation based on fault triggers
+    verdict.is_valid = true;
+    if (t.fail_on_count_mismatch && (verdict.fault_count_low || verdict.fault_count_high)) {
+        verdict.is_valid = false;
+    }
+    if (t.fail_on_undersized && verdict.fault_undersized) {
+        verdict.is_valid = false;
+    }
+    if (t.fail_on_oversized && verdict.fault_oversized) {
+        verdict.is_valid = false;
+    }
+    if (t.fail_on_shape_defects && verdict.fault_shape_defect) {
+        verdict.is_valid = false;
+    }
+    return faults;
+}
+
+// Count fault of a frame or lane verdict, empty if there is none
+template <typename Verdict>
+std::string describeCountFault(const Verdict& verdict) {
+    if (verdict.count_limit < 0) return std::string();
+    const bool low = verdict.dough_count < verdict.count_limit;
+    char text[96];
+    std::snprintf(text, sizeof(text), "COUNT TOO %s: %d (%s %d)", low ? "LOW" : "HIGH",
+                  verdict.dough_count,
+                  verdict.count_expected ? "expected" : (low ? "min" : "max"),
+                  verdict.count_limit);
+    return text;
+}
+
+// Append the count fault and the failed detections of one verdict
+template <typename Verdict>
+void appendFaultMessages(const Verdict& verdict, const std::vector<DetectionMeasurement>& measurements,
+                         int lane, const std::string& prefix, std::vector<std::string>& messages) {
+    const std::string count_fault = describeCountFault(verdict);
+    if (!count_fault.empty()) {
+        messages.push_back(prefix + count_fault);
+    }
+    for (const auto& meas : measurements) {
+        if (meas.lane != lane || meas.meets_specs) continue;
+        messages.push_back(prefix + "Detection #" + std::to_string(meas.id) + ": " +
+                           describeFaults(meas));
+    }
+}
+
+// Merge boxes that overlap or touch until none do; sorted by x afterwards
+void mergeTouchingBoxes(std::vector<cv::Rect>& boxes) {
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (size_t i = 0; i < boxes.size() && !merged; i++) {
+            const cv::Rect grown(boxes[i].x - 1, boxes[i].y - 1,
+                                 boxes[i].width + 2, boxes[i].height + 2);
+            for (size_t j = i + 1; j < boxes.size(); j++) {
+                if ((grown & boxes[j]).area() > 0) {
+                    boxes[i] |= boxes[j];
+                    boxes.erase(boxes.begin() + j);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+    std::sort(boxes.begin(), boxes.end(),
+              [](const cv::Rect& a, const cv::Rect& b) { return a.x < b.x; });
+}
+
+// Change gating grid: tile size and row sampling step
+const int kGateTile = 64;
+const int kGateRowStep = 4;
+
+} // namespace
+
+double faultValue(const DetectionMeasurement& meas, DetectionFault fault) {
+    switch (fault) {
+        case DetectionFault::AreaTooSmall:
+        case DetectionFault::AreaTooLarge:
+            return meas.area_pixels;
+        case DetectionFault::WidthTooSmall:
+        case DetectionFault::WidthTooLarge:
+            return meas.width_pixels;
+        case DetectionFault::LengthTooSmall:
+        case DetectionFault::LengthTooLarge:
+            return meas.height_pixels;
+        case DetectionFault::AspectRatioTooLow:
+        case DetectionFault::AspectRatioTooHigh:
+            return meas.aspect_ratio;
+        case DetectionFault::CircularityTooLow:
+        case DetectionFault::CircularityTooHigh:
+            return meas.circularity;
+        default:
+            return 0.0;
+    }
+}
+
+std::string describeFaults(const DetectionMeasurement& meas) {
+    // Value and limit of each check, in DetectionFault order
+    static const char* const kFormats[] = {
+        "Area too small (%.0fpx², min %.0fpx²)",
+        "Area too large (%.0fpx², max %.0fpx²)",
+        "Width too small (%.0fpx, min %.0fpx)",
+        "Width too large (%.0fpx, max %.0fpx)",
+        "Length too small (%.0fpx, min %.0fpx)",
+        "Length too large (%.0fpx, max %.0fpx)",
+        "Aspect ratio too low (%.2f, min %.2f)",
+        "Aspect ratio too high (%.2f, max %.2f)",
+        "Circularity too low (%.2f, min %.2f)",
+        "Circularity too high (%.2f, max %.2f)",
+    };
+    
+    std::string text;
+    char buffer[96];
+    for (int f = 0; f < static_cast<int>(DetectionFault::Count); f++) {
+        const DetectionFault fault = static_cast<DetectionFault>(f);
+        if (!(meas.faults & faultBit(fault))) continue;
+        std::snprintf(buffer, sizeof(buffer), kFormats[f], faultValue(meas, fault),
+                      meas.fault_limits[f]);
+        if (!text.empty()) text += ", ";
+        text += buffer;
+    }
+    return text;
+}
+
+std::vector<std::string> faultMessages(const DetectionResult& result) {
+    std::vector<std::string> messages;
+    appendFaultMessages(result, result.measurements, -1, std::string(), messages);
+    for (size_t l = 0; l < result.lanes.size(); l++) {
+        appendFaultMessages(result.lanes[l], result.measurements, static_cast<int>(l),
+                            result.lanes[l].name + ": ", messages);
+    }
+    return messages;
+}
+
 VisionPipeline::VisionPipeline()
-    : is_initialized_(false) {
+    : segmented_mask_stale_(false), is_initialized_(false), crop_to_roi_(true),
+      roi_spans_dirty_(false), coarse_factor_(1), change_gating_(false),
+      change_threshold_(4), gate_valid_(false), gate_cols_(0), gate_rows_(0),
+      tracking_(false), pieces_counted_(0), pieces_failed_(0), belt_stitching_(false) {
     color_segmenter_ = std::make_unique<FastColorSegmentation>();
     contour_detector_ = std::make_unique<ContourDetector>();
     rule_engine_ = std::make_unique<RuleEngine>();
@@ -36,11 +286,14 @@ VisionPipeline::VisionPipeline()
     quality_thresholds_.fail_on_oversized = false;
     quality_thresholds_.fail_on_count_mismatch = false;
     quality_thresholds_.fail_on_shape_defects = false;
+    compileQualityPrograms();
 }
 
 VisionPipeline::~VisionPipeline() {}
 
 bool VisionPipeline::initialize(const std::string& config_path) {
+    invalidateGate();
+    
     ConfigManager config_mgr;
     if (!config_mgr.loadConfig(config_path)) {
         std::cerr << "Warning: Could not load config, using defaults" << std::endl;
@@ -53,7 +306,30 @@ bool VisionPipeline::initialize(const std::string& config_path) {
     } else {
         VisionConfig cfg = config_mgr.getConfig();
         color_segmenter_->setColorRange(cfg.color_lower, cfg.color_upper);
+        color_segmenter_->setSegmentationMode(
+            cfg.use_color_lut ? SegmentationMode::DirectLut : SegmentationMode::HsvThreshold);
+        color_segmenter_->setMorphKernelSize(cfg.morph_kernel_size);
+        color_segmenter_->setMaskCleaning(
+            cfg.use_component_filter ? MaskCleaning::Components : MaskCleaning::Morphology);
+        color_segmenter_->setComponentLimits(cfg.min_component_area, cfg.max_hole_area);
+        color_segmenter_->setTiledExecution(cfg.tiled_segmentation);
+        color_segmenter_->setThreadCount(cfg.thread_count);
+        updateCoarseToFine(cfg.coarse_factor);
+        updateChangeGating(cfg.change_gating, cfg.change_threshold);
+        updateTracking(cfg.piece_tracking, cfg.conveyor_direction, cfg.track_max_missed);
+        
+        // Stitching works on whole rows, so the belt must run along the
+        // frame's columns
+        const bool vertical_belt =
+            std::abs(cfg.conveyor_direction.y) >= std::abs(cfg.conveyor_direction.x);
+        if (cfg.belt_stitching && !vertical_belt) {
+            std::cerr << "Warning: belt stitching needs a conveyor moving up or down the frame, "
+                      << "disabled" << std::endl;
+        }
+        updateBeltStitching(cfg.belt_stitching && vertical_belt,
+                            cfg.conveyor_direction.y < 0 ? -1 : 1);
         roi_ = cfg.roi;
+        crop_to_roi_ = cfg.crop_to_roi;
         
         DetectionRules rules;
         rules.min_area = cfg.min_area;
@@ -73,56 +349,183 @@ bool VisionPipeline::initialize(const std::string& config_path) {
 }
 
 DetectionResult VisionPipeline::processFrame(const cv::Mat& frame) {
-    Timer total_timer;
     DetectionResult result;
+    processFrame(frame, result);
+    return result;
+}
+
+void VisionPipeline::processFrame(const cv::Mat& frame, DetectionResult& result) {
+    Timer total_timer;
     result.dough_count = 0;
     result.is_valid = false;
     result.confidence = 0.0;
+    result.fault_count_low = false;
+    result.fault_count_high = false;
+    result.fault_undersized = false;
+    result.fault_oversized = false;
+    result.fault_shape_defect = false;
+    result.full_res_fraction = 0.0;
+    result.reused = false;
+    result.dirty_fraction = 0.0;
+    result.segmentation_time_ms = 0.0;
+    result.contour_time_ms = 0.0;
+    result.rule_time_ms = 0.0;
+    result.total_time_ms = 0.0;
+    result.band_times_ms.clear();
+    result.finished_pieces.clear();
     
     if (frame.empty() || !is_initialized_) {
+        result.contours.clear();
+        result.measurements.clear();
+        result.lanes.clear();
+        result.mask.reset(cv::Rect());
         result.message = "Invalid frame or not initialized";
-        return result;
+        return;
     }
     
-    // Always segment on full frame - no ROI cropping
     Timer seg_timer;
-    color_segmenter_->segment(frame, segmented_mask_);
-    
-    // If ROI is set, zero out segmentation outside ROI so no detections appear there
-    if (roi_.width > 0 && roi_.height > 0) {
-        cv::Rect safe_roi = roi_ & cv::Rect(0, 0, frame.cols, frame.rows);
-        if (safe_roi.width > 0 && safe_roi.height > 0) {
-            cv::Mat masked = cv::Mat::zeros(segmented_mask_.size(), segmented_mask_.type());
-            segmented_mask_(safe_roi).copyTo(masked(safe_roi));
-            segmented_mask_ = masked;
-        } else {
-            // ROI is out of bounds; clear entire mask
-            segmented_mask_ = cv::Mat::zeros(segmented_mask_.size(), segmented_mask_.type());
+    
+    // The mask is kept as runs; the dense copy callers overlay on the frame
+    // is only built when asked for
+    const cv::Rect frame_rect(0, 0, frame.cols, frame.rows);
+    mask_frame_size_ = frame.size();
+    segmented_mask_stale_ = true;
+    
+    // Polygon spans are rasterized once and reused until the polygons or the
+    // frame size change
+    const bool use_polygons = !roi_polygons_.empty();
+    if (use_polygons && (roi_spans_dirty_ || roi_spans_size_ != frame.size())) {
+        rasterizeRoiPolygons(roi_polygons_, frame.size(), roi_spans_);
+        roi_spans_size_ = frame.size();
+        roi_spans_dirty_ = false;
+    }
+    
+    // Area of the frame that is segmented and labelled this frame
+    cv::Rect work_area = frame_rect;
+    if (use_polygons) {
+        work_area = roi_spans_.bounds;
+    } else if (roi_.width > 0 && roi_.height > 0) {
+        work_area = roi_ & frame_rect;
+    }
+    
+    // Changed-frame gating: an unchanged frame returns the previous result,
+    // a partly changed one re-segments only its changed tiles
+    bool partial = false;
+    const bool has_area = work_area.width > 0 && work_area.height > 0;
+    if (change_gating_ && !belt_stitching_ && gate_valid_ && has_area &&
+        mask_runs_.bounds == work_area &&
+        gate_reference_.rows == (frame.rows + kGateRowStep - 1) / kGateRowStep &&
+        gate_reference_.cols == frame.cols) {
+        int checked = 0;
+        const int dirty = findDirtyTiles(frame, work_area, checked);
+        if (dirty == 0) {
+            // Copied element-wise into the caller's buffers
+            result = last_result_;
+            result.reused = true;
+            result.finished_pieces.clear();  // Already reported
+            result.dirty_fraction = 0.0;
+            result.band_times_ms.clear();
+            result.segmentation_time_ms = seg_timer.elapsedMs();
+            result.contour_time_ms = 0.0;
+            result.rule_time_ms = 0.0;
+            result.total_time_ms = total_timer.elapsedMs();
+            segmented_mask_stale_ = false;  // Dense copy, if built, still holds
+            recordTiming(result);
+            return;
+        }
+        
+        // Tiles can only be cleaned on their own when cleaning is local and
+        // the ROI is cropped first; otherwise, or when most tiles changed,
+        // the whole work area is segmented
+        partial = coarse_factor_ <= 1 &&
+                  color_segmenter_->getMaskCleaning() == MaskCleaning::Morphology &&
+                  (use_polygons || crop_to_roi_) && dirty * 2 <= checked;
+        if (partial) {
+            result.dirty_fraction = static_cast<double>(dirty) / checked;
         }
     }
+    
+    if (!has_area) {
+        // ROI is out of bounds; nothing to segment
+        mask_runs_.reset(cv::Rect());
+    } else if (belt_stitching_) {
+        // Only the rows the belt brought in; whole pieces come out
+        result.full_res_fraction = segmentBeltStrip(frame, work_area, use_polygons);
+    } else if (partial) {
+        resegmentDirtyTiles(frame, work_area, use_polygons);
+    } else if (coarse_factor_ > 1) {
+        // Coarse-to-fine: full resolution only around candidates
+        result.full_res_fraction = segmentCoarseToFine(frame, work_area, use_polygons);
+    } else if (use_polygons) {
+        // Polygon ROI: always crop to its bounds and classify only the spans
+        color_segmenter_->segment(frame(work_area), mask_runs_, &roi_spans_, work_area.tl());
+    } else if (crop_to_roi_) {
+        // Crop first: convert, threshold and clean only the ROI
+        color_segmenter_->segment(frame(work_area), mask_runs_, nullptr, work_area.tl());
+    } else {
+        // Segment and clean the full frame, then drop the runs outside the
+        // ROI so no detections appear there
+        color_segmenter_->segment(frame, mask_runs_);
+        clipMask(mask_runs_, work_area);
+    }
+    if (change_gating_ && !belt_stitching_) {
+        updateGateReference(frame, partial);
+        gate_valid_ = has_area;
+    }
     result.segmentation_time_ms = seg_timer.elapsedMs();
+    if (has_area && !partial) {
+        result.dirty_fraction = 1.0;
+    }
+    if (has_area && coarse_factor_ <= 1 && !belt_stitching_) {
+        if (!partial) {
+            result.band_times_ms = color_segmenter_->getLastBandTimesMs();
+        }
+        result.full_res_fraction = 1.0;
+    }
     
-    // Find and extract contours with timing
+    // Label and measure every blob in one pass over the runs, in frame
+    // coordinates. Contours are traced below, only for the detections that
+    // pass the rules.
     Timer contour_timer;
-    std::vector<std::vector<cv::Point>> contours = 
-        contour_detector_->findContours(segmented_mask_);
-    std::vector<ContourFeatures> features = 
-        contour_detector_->extractFeatures(contours);
+    contour_detector_->measureBlobs(mask_runs_, features_);
     result.contour_time_ms = contour_timer.elapsedMs();
     
-    // Apply rules to filter valid dough pieces and calculate measurements
+    // Apply rules to filter valid dough pieces and calculate measurements.
+    // The rules and every threshold set run as compiled checks over all
+    // blobs at once; measurements are written over the caller's previous
+    // ones.
     Timer rule_timer;
-    std::vector<std::vector<cv::Point>> valid_contours;
-    std::vector<cv::Rect> bounding_boxes;
-    std::vector<cv::Point2f> centers;
-    std::vector<DetectionMeasurement> measurements;
+    const std::vector<ContourFeatures>& features = features_;
+    feature_columns_.resize(features.size());
+    float* areas = feature_columns_.column(FeatureColumn::Area);
+    float* widths = feature_columns_.column(FeatureColumn::Width);
+    float* heights = feature_columns_.column(FeatureColumn::Height);
+    float* aspect_ratios = feature_columns_.column(FeatureColumn::AspectRatio);
+    float* circularities = feature_columns_.column(FeatureColumn::Circularity);
+    for (size_t i = 0; i < features.size(); i++) {
+        areas[i] = static_cast<float>(features[i].area);
+        widths[i] = static_cast<float>(features[i].bounding_box.width);
+        heights[i] = static_cast<float>(features[i].bounding_box.height);
+        aspect_ratios[i] = static_cast<float>(features[i].aspect_ratio);
+        circularities[i] = static_cast<float>(features[i].circularity);
+    }
+    rule_engine_->validateContours(feature_columns_, rejected_);
+    quality_faults_.resize(quality_programs_.size());
+    for (size_t p = 0; p < quality_programs_.size(); p++) {
+        quality_programs_[p].evaluate(feature_columns_, quality_faults_[p]);
+    }
     
-    // Check if ROI filtering is enabled
-    bool use_roi_filter = (roi_.width > 0 && roi_.height > 0);
+    std::vector<DetectionMeasurement>& measurements = result.measurements;
+    size_t detections = 0;
+    valid_blobs_.clear();
+    
+    // Check if ROI filtering is enabled (a polygon ROI is already enforced
+    // by the mask, and stitched pieces may reach past the ROI by now)
+    bool use_roi_filter = !use_polygons && !belt_stitching_ && (roi_.width > 0 && roi_.height > 0);
     
     int detection_id = 1;
     for (size_t i = 0; i < features.size(); i++) {
-        if (rule_engine_->validateContour(features[i])) {
+        if (!rejected_[i]) {
             // If ROI is set, only keep detections whose center is inside ROI
             if (use_roi_filter) {
                 if (!roi_.contains(features[i].center)) {
@@ -131,7 +534,8 @@ DetectionResult VisionPipeline::processFrame(const cv::Mat& frame) {
             }
             
             // Create detailed measurement for this detection
-            DetectionMeasurement meas;
+            if (detections == measurements.size()) measurements.emplace_back();
+            DetectionMeasurement& meas = measurements[detections++];
             meas.id = detection_id++;
             meas.area_pixels = features[i].area;
             meas.width_pixels = features[i].bounding_box.width;
@@ -140,186 +544,200 @@ DetectionResult VisionPipeline::processFrame(const cv::Mat& frame) {
             meas.circularity = features[i].circularity;
             meas.center = features[i].center;
             meas.bbox = features[i].bounding_box;
-            meas.meets_specs = true;  // Will be updated in fault detection
-            
-            // Individual threshold checks - respect enable flags
-            bool width_ok = true;
-            bool length_ok = true;
-            bool area_ok = true;
-            bool aspect_ratio_ok = true;
-            bool circularity_ok = true;
-            
-            // Area check (if enabled)
-            if (quality_thresholds_.enable_area_check) {
-                if (quality_thresholds_.min_area > 0 && meas.area_pixels < quality_thresholds_.min_area) {
-                    meas.meets_specs = false;
-                    area_ok = false;
-                    if (!meas.fault_reason.empty()) meas.fault_reason += ", ";
-                    meas.fault_reason += "Area too small (" + std::to_string((int)meas.area_pixels) + "px²)";
-                }
-                if (quality_thresholds_.max_area > 0 && meas.area_pixels > quality_thresholds_.max_area) {
-                    meas.meets_specs = false;
-                    area_ok = false;
-                    if (!meas.fault_reason.empty()) meas.fault_reason += ", ";
-                    meas.fault_reason += "Area too large (" + std::to_string((int)meas.area_pixels) + "px²)";
-                }
-            }
-            
-            // Width check (if enabled)
-            if (quality_thresholds_.enable_width_check) {
-                if (quality_thresholds_.min_width > 0 && meas.width_pixels < quality_thresholds_.min_width) {
-                    meas.meets_specs = false;
-                    width_ok = false;
-                    if (!meas.fault_reason.empty()) meas.fault_reason += ", ";
-                    meas.fault_reason += "Width too small (" + std::to_string((int)meas.width_pixels) + "px)";
-                }
-                if (quality_thresholds_.max_width > 0 && meas.width_pixels > quality_thresholds_.max_width) {
-                    meas.meets_specs = false;
-                    width_ok = false;
-                    if (!meas.fault_reason.empty()) meas.fault_reason += ", ";
-                    meas.fault_reason += "Width too large (" + std::to_string((int)meas.width_pixels) + "px)";
-                }
-            }
+            meas.lane = findLane(meas.center);
+            meas.track_id = -1;
             
-            // Height/Length check (if enabled)
-            if (quality_thresholds_.enable_height_check) {
-                if (quality_thresholds_.min_height > 0 && meas.height_pixels < quality_thresholds_.min_height) {
-                    meas.meets_specs = false;
-                    length_ok = false;
-                    if (!meas.fault_reason.empty()) meas.fault_reason += ", ";
-                    meas.fault_reason += "Length too small (" + std::to_string((int)meas.height_pixels) + "px)";
-                }
-                if (quality_thresholds_.max_height > 0 && meas.height_pixels > quality_thresholds_.max_height) {
-                    meas.meets_specs = false;
-                    length_ok = false;
-                    if (!meas.fault_reason.empty()) meas.fault_reason += ", ";
-                    meas.fault_reason += "Length too large (" + std::to_string((int)meas.height_pixels) + "px)";
-                }
-            }
+            // Threshold checks of the lane, or the global ones outside
+            // every lane
+            const size_t program = static_cast<size_t>(meas.lane + 1);
+            applyFaults(meas, quality_faults_[program][i], quality_programs_[program]);
             
-            // Aspect ratio check (if enabled)
-            if (quality_thresholds_.enable_aspect_ratio_check) {
-                if (quality_thresholds_.min_aspect_ratio > 0 && meas.aspect_ratio < quality_thresholds_.min_aspect_ratio) {
-                    meas.meets_specs = false;
-                    aspect_ratio_ok = false;
-                    if (!meas.fault_reason.empty()) meas.fault_reason += ", ";
-                    meas.fault_reason += "Aspect ratio too low (" + std::to_string(meas.aspect_ratio) + ")";
-                }
-                if (quality_thresholds_.max_aspect_ratio > 0 && meas.aspect_ratio > quality_thresholds_.max_aspect_ratio) {
-                    meas.meets_specs = false;
-                    aspect_ratio_ok = false;
-                    if (!meas.fault_reason.empty()) meas.fault_reason += ", ";
-                    meas.fault_reason += "Aspect ratio too high (" + std::to_string(meas.aspect_ratio) + ")";
-                }
-            }
-            
-            // Circularity check (if enabled)
-            if (quality_thresholds_.enable_circularity_check) {
-                if (quality_thresholds_.min_circularity > 0 && meas.circularity < quality_thresholds_.min_circularity) {
-                    meas.meets_specs = false;
-                    circularity_ok = false;
-                    if (!meas.fault_reason.empty()) meas.fault_reason += ", ";
-                    meas.fault_reason += "Circularity too low (" + std::to_string(meas.circularity) + ")";
-                }
-                if (quality_thresholds_.max_circularity > 0 && meas.circularity > quality_thresholds_.max_circularity) {
-                    meas.meets_specs = false;
-                    circularity_ok = false;
-                    if (!meas.fault_reason.empty()) meas.fault_reason += ", ";
-                    meas.fault_reason += "Circularity too high (" + std::to_string(meas.circularity) + ")";
-                }
-            }
-            
-            valid_contours.push_back(contours[i]);
-            bounding_boxes.push_back(features[i].bounding_box);
-            centers.push_back(features[i].center);
-            measurements.push_back(meas);
+            valid_blobs_.push_back(i);
+        }
+    }
+    measurements.resize(detections);
+    
+    if (tracking_ && !belt_stitching_) {
+        trackPieces(measurements, work_area, result);
+    } else if (belt_stitching_) {
+        // Stitched pieces are each reported in exactly one frame
+        for (const auto& meas : measurements) {
+            pieces_counted_++;
+            if (!meas.meets_specs) pieces_failed_++;
         }
     }
     result.rule_time_ms = rule_timer.elapsedMs();
     
-    result.contours = valid_contours;
-    result.bounding_boxes = bounding_boxes;
-    result.centers = centers;
-    result.measurements = measurements;
-    result.dough_count = static_cast<int>(valid_contours.size());
+    // Trace contours for the detections only, into one flat buffer reused
+    // across frames
+    Timer trace_timer;
+    contour_arena_.clear();
+    for (size_t blob : valid_blobs_) {
+        contour_detector_->traceBlob(blob, contour_arena_);
+    }
+    contour_arena_.views(result.contours);
+    result.contour_time_ms += trace_timer.elapsedMs();
     
-    // Initialize fault flags
-    result.fault_count_low = false;
-    result.fault_count_high = false;
-    result.fault_undersized = false;
-    result.fault_oversized = false;
-    result.fault_shape_defect = false;
-    result.fault_messages.clear();
+    result.dough_count = static_cast<int>(result.contours.size());
     
-    // Count validation (if enabled)
-    if (quality_thresholds_.enable_count_check) {
-        if (quality_thresholds_.enforce_exact_count && result.dough_count != quality_thresholds_.expected_count) {
-            result.fault_count_low = result.dough_count < quality_thresholds_.expected_count;
-            result.fault_count_high = result.dough_count > quality_thresholds_.expected_count;
-            if (result.fault_count_low) {
-                result.fault_messages.push_back("COUNT TOO LOW: " + std::to_string(result.dough_count) + 
-                                               " (expected " + std::to_string(quality_thresholds_.expected_count) + ")");
-            }
-            if (result.fault_count_high) {
-                result.fault_messages.push_back("COUNT TOO HIGH: " + std::to_string(result.dough_count) + 
-                                               " (expected " + std::to_string(quality_thresholds_.expected_count) + ")");
-            }
-        } else if (quality_thresholds_.min_count > 0 && result.dough_count < quality_thresholds_.min_count) {
-            result.fault_count_low = true;
-            result.fault_messages.push_back("COUNT TOO LOW: " + std::to_string(result.dough_count) + 
-                                           " (min " + std::to_string(quality_thresholds_.min_count) + ")");
-        } else if (quality_thresholds_.max_count > 0 && result.dough_count > quality_thresholds_.max_count) {
-            result.fault_count_high = true;
-            result.fault_messages.push_back("COUNT TOO HIGH: " + std::to_string(result.dough_count) + 
-                                           " (max " + std::to_string(quality_thresholds_.max_count) + ")");
-        }
+    // Copy-assigned, so the run buffers are reused; grown with room to
+    // spare so a slightly busier frame does not reallocate them
+    if (result.mask.runs.capacity() < mask_runs_.runs.size()) {
+        result.mask.runs.reserve(mask_runs_.runs.size() * 2);
     }
+    result.mask = mask_runs_;
     
-    // Individual detection faults
-    for (const auto& meas : measurements) {
-        if (!meas.meets_specs) {
-            if (meas.fault_reason.find("Undersized") != std::string::npos) {
-                result.fault_undersized = true;
-            }
-            if (meas.fault_reason.find("Oversized") != std::string::npos) {
-                result.fault_oversized = true;
-            }
-            if (meas.fault_reason.find("Shape") != std::string::npos) {
-                result.fault_shape_defect = true;
-            }
-            result.fault_messages.push_back("Detection #" + std::to_string(meas.id) + ": " + meas.fault_reason);
+    // Frame verdict: total count against the global thresholds, plus the
+    // detections that fall outside every lane
+    int faults = judgeDetections(result, result.dough_count, measurements, -1,
+                                 quality_thresholds_);
+    
+    // Lane verdicts, each from its own detections and thresholds. Any lane
+    // fault also fails the frame.
+    result.lanes.resize(lanes_.size());
+    for (size_t l = 0; l < lanes_.size(); l++) {
+        const int lane = static_cast<int>(l);
+        int lane_count = 0;
+        for (const auto& meas : measurements) {
+            if (meas.lane == lane) lane_count++;
         }
-    }
     
-    // Overall validation based on fault triggers
-    result.is_valid = true;
-    if (quality_thresholds_.fail_on_count_mismatch && (result.fault_count_low || result.fault_count_high)) {
-        result.is_valid = false;
-    }
-    if (quality_thresholds_.fail_on_undersized && result.fault_undersized) {
-        result.is_valid = false;
-    }
-    if (quality_thresholds_.fail_on_oversized && result.fault_oversized) {
-        result.is_valid = false;
-    }
-    if (quality_thresholds_.fail_on_shape_defects && result.fault_shape_defect) {
-        result.is_valid = false;
+        LaneResult& lane_result = result.lanes[l];
+        lane_result.name = lanes_[l].name;
+        faults += judgeDetections(lane_result, lane_count, measurements, lane,
+                                  lanes_[l].thresholds);
+        
+        result.fault_count_low |= lane_result.fault_count_low;
+        result.fault_count_high |= lane_result.fault_count_high;
+        result.fault_undersized |= lane_result.fault_undersized;
+        result.fault_oversized |= lane_result.fault_oversized;
+        result.fault_shape_defect |= lane_result.fault_shape_defect;
+        result.is_valid = result.is_valid && lane_result.is_valid;
     }
     
     // Set message
     if (result.is_valid) {
         result.message = "PASS";
     } else {
-        result.message = "FAIL: " + std::to_string(result.fault_messages.size()) + " fault(s)";
+        char text[32];
+        std::snprintf(text, sizeof(text), "FAIL: %d fault(s)", faults);
+        result.message = text;
     }
     
     result.confidence = result.dough_count > 0 ? 0.85 : 0.0;
     result.total_time_ms = total_timer.elapsedMs();
     
+    recordTiming(result);
+    if (change_gating_) {
+        last_result_ = result;
+    }
+}
+
+double VisionPipeline::segmentBeltStrip(const cv::Mat& frame, const cv::Rect& work_area,
+                                        bool use_polygons) {
+    const int exposed = belt_stitcher_.advance(frame, work_area);
+    if (exposed > 0) {
+        // The new rows plus enough rows already seen that they are cleaned
+        // as they would be in the whole area
+        const int halo = color_segmenter_->getCleaningHalo();
+        const int rows = std::min(work_area.height, exposed + halo);
+        const cv::Rect strip(work_area.x,
+                             belt_stitcher_.getDirection() > 0 ? work_area.y
+                                                               : work_area.br().y - rows,
+                             work_area.width, rows);
+        const RoiSpans* spans = nullptr;
+        if (use_polygons) {
+            cropSpans(roi_spans_, strip, stitch_spans_);
+            spans = &stitch_spans_;
+        }
+        
+        // Component cleaning judges whole components, so strips are only
+        // classified and the finished pieces cleaned below
+        if (color_segmenter_->getMaskCleaning() == MaskCleaning::Components) {
+            color_segmenter_->classify(frame(strip), stitch_strip_, spans, strip.tl());
+        } else {
+            color_segmenter_->segment(frame(strip), stitch_strip_, spans, strip.tl());
+        }
+        belt_stitcher_.append(stitch_strip_, exposed);
+    }
+    
+    belt_stitcher_.takeComplete(work_area, mask_runs_);
+    if (color_segmenter_->getMaskCleaning() == MaskCleaning::Components &&
+        mask_runs_.bounds.area() > 0) {
+        color_segmenter_->cleanMask(mask_runs_);
+    }
+    return static_cast<double>(exposed) / work_area.height;
+}
+
+void VisionPipeline::trackPieces(std::vector<DetectionMeasurement>& measurements,
+                                 const cv::Rect& work_area, DetectionResult& result) {
+    track_centers_.clear();
+    track_boxes_.clear();
+    for (const auto& meas : measurements) {
+        track_centers_.push_back(meas.center);
+        track_boxes_.push_back(meas.bbox);
+    }
+    piece_tracker_.update(track_centers_, track_boxes_, work_area, track_ids_, ended_tracks_);
+    
+    for (size_t i = 0; i < measurements.size(); i++) {
+        DetectionMeasurement& meas = measurements[i];
+        meas.track_id = track_ids_[i];
+        TrackedPiece& piece = openPiece(meas.track_id);
+        
+        if (piece.complete) {
+            // Judged already: keep its measurements and verdict, only the
+            // position follows the piece
+            const int id = meas.id;
+            const cv::Point2f center = meas.center;
+            const cv::Rect bbox = meas.bbox;
+            meas = piece.measurement;
+            meas.id = id;
+            meas.center = center;
+            meas.bbox = bbox;
+        } else {
+            // A box clear of the area's edges is the whole piece and becomes
+            // its verdict; until then keep the largest partial view
+            const bool inside = meas.bbox.x > work_area.x && meas.bbox.y > work_area.y &&
+                                meas.bbox.br().x < work_area.br().x &&
+                                meas.bbox.br().y < work_area.br().y;
+            if (inside || piece.frames_seen == 0 ||
+                meas.area_pixels > piece.measurement.area_pixels) {
+                piece.measurement = meas;
+            }
+            piece.complete = inside;
+        }
+        piece.frames_seen++;
+    }
+    
+    // One final verdict per piece that left
+    for (int id : ended_tracks_) {
+        for (size_t i = 0; i < open_pieces_.size(); i++) {
+            if (open_pieces_[i].track_id != id) continue;
+            const TrackedPiece& piece = open_pieces_[i].piece;
+            result.finished_pieces.push_back(piece);
+            pieces_counted_++;
+            if (!piece.measurement.meets_specs) pieces_failed_++;
+            open_pieces_[i] = open_pieces_.back();
+            open_pieces_.pop_back();
+            break;
+        }
+    }
+}
+
+TrackedPiece& VisionPipeline::openPiece(int track_id) {
+    for (OpenPiece& open : open_pieces_) {
+        if (open.track_id == track_id) return open.piece;
+    }
+    open_pieces_.push_back(OpenPiece{track_id, TrackedPiece{}});
+    return open_pieces_.back().piece;
+}
+
+void VisionPipeline::recordTiming(const DetectionResult& result) {
     // Track performance stats
     frame_times_.push_back(result.total_time_ms);
     segmentation_times_.push_back(result.segmentation_time_ms);
     contour_times_.push_back(result.contour_time_ms);
+    last_band_times_ms_ = result.band_times_ms;
     
     // Keep only last 100 frames for stats
     if (frame_times_.size() > 100) {
@@ -327,21 +745,200 @@ DetectionResult VisionPipeline::processFrame(const cv::Mat& frame) {
         segmentation_times_.erase(segmentation_times_.begin());
         contour_times_.erase(contour_times_.begin());
     }
+}
+    
+int VisionPipeline::findDirtyTiles(const cv::Mat& frame, const cv::Rect& work_area, int& checked) {
+    const SimdKernels& kernels = simdKernels();
+    const int tx0 = work_area.x / kGateTile;
+    const int ty0 = work_area.y / kGateTile;
+    const int tx1 = (work_area.x + work_area.width - 1) / kGateTile;
+    const int ty1 = (work_area.y + work_area.height - 1) / kGateTile;
+    
+    std::fill(dirty_tiles_.begin(), dirty_tiles_.end(), 0);
+    int dirty = 0;
+    checked = 0;
+    for (int ty = ty0; ty <= ty1; ty++) {
+        const int y_end = std::min(frame.rows, (ty + 1) * kGateTile);
+        for (int tx = tx0; tx <= tx1; tx++) {
+            const int x = tx * kGateTile;
+            const int bytes = (std::min(frame.cols, x + kGateTile) - x) * 3;
+            
+            // Mean absolute difference over the sampled rows of the tile
+            uint64_t sad = 0;
+            int64_t sampled = 0;
+            for (int y = ty * kGateTile; y < y_end; y += kGateRowStep) {
+                sad += kernels.sum_abs_diff(frame.ptr<uint8_t>(y) + x * 3,
+                                            gate_reference_.ptr<uint8_t>(y / kGateRowStep) + x * 3,
+                                            bytes);
+                sampled += bytes;
+            }
+            checked++;
+            if (sad > static_cast<uint64_t>(change_threshold_) * sampled) {
+                dirty_tiles_[ty * gate_cols_ + tx] = 1;
+                dirty++;
+            }
+        }
+    }
+    return dirty;
+}
+
+void VisionPipeline::updateGateReference(const cv::Mat& frame, bool dirty_only) {
+    const int rows = (frame.rows + kGateRowStep - 1) / kGateRowStep;
+    if (gate_reference_.rows != rows || gate_reference_.cols != frame.cols ||
+        gate_reference_.type() != CV_8UC3) {
+        gate_reference_.create(rows, frame.cols, CV_8UC3);
+        gate_cols_ = (frame.cols + kGateTile - 1) / kGateTile;
+        gate_rows_ = (frame.rows + kGateTile - 1) / kGateTile;
+        dirty_tiles_.assign(static_cast<size_t>(gate_cols_) * gate_rows_, 0);
+        dirty_only = false;
+    }
     
-    return result;
+    // A tile's reference is the frame it was last segmented from, so slow
+    // drift still adds up to a change
+    for (int y = 0; y < frame.rows; y += kGateRowStep) {
+        const uint8_t* src = frame.ptr<uint8_t>(y);
+        uint8_t* dst = gate_reference_.ptr<uint8_t>(y / kGateRowStep);
+        if (!dirty_only) {
+            std::memcpy(dst, src, static_cast<size_t>(frame.cols) * 3);
+            continue;
+        }
+        const uint8_t* dirty = &dirty_tiles_[(y / kGateTile) * gate_cols_];
+        for (int tx = 0; tx < gate_cols_; tx++) {
+            if (!dirty[tx]) continue;
+            const int x = tx * kGateTile;
+            const int bytes = (std::min(frame.cols, x + kGateTile) - x) * 3;
+            std::memcpy(dst + x * 3, src + x * 3, bytes);
+        }
+    }
+}
+
+void VisionPipeline::resegmentDirtyTiles(const cv::Mat& frame, const cv::Rect& work_area,
+                                         bool use_polygons) {
+    // Each changed tile is segmented with twice the cleaning reach around
+    // it; only the part more than one reach from a cut is spliced in, which
+    // still covers every pixel the change can affect
+    const int halo = color_segmenter_->getCleaningHalo();
+    fine_boxes_.clear();
+    for (int ty = 0; ty < gate_rows_; ty++) {
+        for (int tx = 0; tx < gate_cols_; tx++) {
+            if (!dirty_tiles_[ty * gate_cols_ + tx]) continue;
+            const cv::Rect box(tx * kGateTile - 2 * halo, ty * kGateTile - 2 * halo,
+                               kGateTile + 4 * halo, kGateTile + 4 * halo);
+            fine_boxes_.push_back(box & work_area);
+        }
+    }
+    mergeTouchingBoxes(fine_boxes_);
+    
+    // Sides on the work area edge pad exactly as the full work area does
+    const int right = work_area.x + work_area.width;
+    const int bottom = work_area.y + work_area.height;
+    splice_areas_.clear();
+    fine_masks_.resize(fine_boxes_.size());
+    for (size_t i = 0; i < fine_boxes_.size(); i++) {
+        const cv::Rect& box = fine_boxes_[i];
+        const int x0 = box.x == work_area.x ? box.x : box.x + halo;
+        const int y0 = box.y == work_area.y ? box.y : box.y + halo;
+        const int x1 = box.x + box.width == right ? right : box.x + box.width - halo;
+        const int y1 = box.y + box.height == bottom ? bottom : box.y + box.height - halo;
+        splice_areas_.push_back(cv::Rect(x0, y0, x1 - x0, y1 - y0));
+        
+        if (use_polygons) {
+            cropSpans(roi_spans_, box, fine_spans_);
+            color_segmenter_->segment(frame(box), fine_masks_[i], &fine_spans_, box.tl());
+        } else {
+            color_segmenter_->segment(frame(box), fine_masks_[i], nullptr, box.tl());
+        }
+    }
+    
+    // Previous runs outside the splice areas, new runs inside them
+    splice_mask_.reset(work_area);
+    for (int y = 0; y < work_area.height; y++) {
+        const int frame_y = y + work_area.y;
+        row_runs_.clear();
+        for (int r = mask_runs_.rowBegin(y); r < mask_runs_.rowEnd(y); r++) {
+            int begin = mask_runs_.runs[r][0];
+            const int end = mask_runs_.runs[r][1];
+            for (const auto& area : splice_areas_) {
+                if (frame_y < area.y || frame_y >= area.y + area.height) continue;
+                const int cut0 = area.x - work_area.x;
+                const int cut1 = cut0 + area.width;
+                if (cut1 <= begin || cut0 >= end) continue;
+                if (cut0 > begin) row_runs_.push_back(cv::Vec2i(begin, cut0));
+                begin = std::max(begin, cut1);
+            }
+            if (begin < end) row_runs_.push_back(cv::Vec2i(begin, end));
+        }
+        for (size_t i = 0; i < fine_boxes_.size(); i++) {
+            const cv::Rect& area = splice_areas_[i];
+            const RleMask& box_mask = fine_masks_[i];
+            if (frame_y < area.y || frame_y >= area.y + area.height) continue;
+            const int box_y = frame_y - box_mask.bounds.y;
+            const int dx = box_mask.bounds.x - work_area.x;
+            const int cut0 = area.x - work_area.x;
+            const int cut1 = cut0 + area.width;
+            for (int r = box_mask.rowBegin(box_y); r < box_mask.rowEnd(box_y); r++) {
+                const int begin = std::max(box_mask.runs[r][0] + dx, cut0);
+                const int end = std::min(box_mask.runs[r][1] + dx, cut1);
+                if (begin < end) row_runs_.push_back(cv::Vec2i(begin, end));
+            }
+        }
+        
+        // Sort and join runs that meet at a splice edge
+        std::sort(row_runs_.begin(), row_runs_.end(),
+                  [](const cv::Vec2i& a, const cv::Vec2i& b) { return a[0] < b[0]; });
+        splice_mask_.row_offsets[y] = static_cast<int>(splice_mask_.runs.size());
+        const size_t row_begin = splice_mask_.runs.size();
+        for (const auto& run : row_runs_) {
+            if (splice_mask_.runs.size() > row_begin && splice_mask_.runs.back()[1] >= run[0]) {
+                splice_mask_.runs.back()[1] = std::max(splice_mask_.runs.back()[1], run[1]);
+            } else {
+                splice_mask_.runs.push_back(run);
+            }
+        }
+    }
+    splice_mask_.row_offsets[work_area.height] = static_cast<int>(splice_mask_.runs.size());
+    std::swap(mask_runs_, splice_mask_);
 }
 
 void VisionPipeline::renderDetections(cv::Mat& frame, const DetectionResult& result) {
-    // Draw ROI rectangle
-    if (roi_.width > 0 && roi_.height > 0) {
+    // Draw ROI polygons, or the ROI rectangle
+    if (!roi_polygons_.empty()) {
+        for (const auto& polygon : roi_polygons_) {
+            std::vector<cv::Point> outline;
+            for (const auto& p : polygon.points) {
+                outline.push_back(cv::Point(cvRound(p.x), cvRound(p.y)));
+            }
+            cv::polylines(frame, outline, true, cv::Scalar(255, 255, 0), 2);
+        }
+    } else if (roi_.width > 0 && roi_.height > 0) {
         cv::rectangle(frame, roi_, cv::Scalar(255, 255, 0), 2);
     }
     
-    bool roi_enabled = (roi_.width > 0 && roi_.height > 0);
+    // Draw lane outlines with their counts
+    for (size_t l = 0; l < lanes_.size(); l++) {
+        std::vector<cv::Point> outline;
+        for (const auto& p : lanes_[l].region.points) {
+            outline.push_back(cv::Point(cvRound(p.x), cvRound(p.y)));
+        }
+        bool lane_ok = l >= result.lanes.size() || result.lanes[l].is_valid;
+        cv::Scalar lane_color = lane_ok ? cv::Scalar(0, 200, 0) : cv::Scalar(0, 0, 255);
+        cv::polylines(frame, outline, true, lane_color, 1);
+        
+        std::string lane_label = lanes_[l].name;
+        if (l < result.lanes.size()) {
+            lane_label += ": " + std::to_string(result.lanes[l].dough_count);
+        }
+        cv::Rect lane_box = cv::boundingRect(outline);
+        cv::putText(frame, lane_label, cv::Point(lane_box.x + 5, lane_box.y + lane_box.height - 8),
+                   cv::FONT_HERSHEY_SIMPLEX, 0.5, lane_color, 1);
+    }
+    
+    bool roi_enabled = roi_polygons_.empty() && (roi_.width > 0 && roi_.height > 0);
     
     // Draw contours and bounding boxes with ROI-aware clipping
     for (size_t i = 0; i < result.contours.size(); i++) {
-        const cv::Rect& bbox = result.bounding_boxes[i];
+        const cv::Rect& bbox = result.measurements[i].bbox;
+        const cv::Point2f& center = result.measurements[i].center;
         
         if (roi_enabled) {
             // Clip bbox to ROI
@@ -353,14 +950,14 @@ void VisionPipeline::renderDetections(cv::Mat& frame, const DetectionResult& res
             
             // Draw contour only inside ROI using overlay + ROI copy
             cv::Mat overlay = cv::Mat::zeros(frame.size(), frame.type());
-            cv::drawContours(overlay, result.contours, static_cast<int>(i), cv::Scalar(0, 255, 0), 2);
+            drawContour(overlay, result.contours[i], cv::Scalar(0, 255, 0), 2);
             cv::Mat frame_roi = frame(roi_);
             cv::Mat overlay_roi = overlay(roi_);
             cv::addWeighted(frame_roi, 1.0, overlay_roi, 1.0, 0.0, frame_roi);
             
             // Draw center point only if inside ROI
-            if (roi_.contains(result.centers[i])) {
-                cv::circle(frame, result.centers[i], 5, cv::Scalar(0, 0, 255), -1);
+            if (roi_.contains(center)) {
+                cv::circle(frame, center, 5, cv::Scalar(0, 0, 255), -1);
             }
             
             // Draw label at clipped top-left if visible
@@ -372,9 +969,9 @@ void VisionPipeline::renderDetections(cv::Mat& frame, const DetectionResult& res
             }
         } else {
             // Normal drawing when no ROI
-            cv::drawContours(frame, result.contours, static_cast<int>(i), cv::Scalar(0, 255, 0), 2);
+            drawContour(frame, result.contours[i], cv::Scalar(0, 255, 0), 2);
             cv::rectangle(frame, bbox, cv::Scalar(255, 0, 0), 2);
-            cv::circle(frame, result.centers[i], 5, cv::Scalar(0, 0, 255), -1);
+            cv::circle(frame, center, 5, cv::Scalar(0, 0, 255), -1);
             std::string label = std::to_string(i + 1);
             cv::putText(frame, label, 
                        cv::Point(bbox.x, bbox.y - 5),
@@ -396,24 +993,227 @@ void VisionPipeline::renderDetections(cv::Mat& frame, const DetectionResult& res
 }
 
 void VisionPipeline::updateColorRange(const cv::Scalar& lower, const cv::Scalar& upper) {
+    invalidateGate();
     color_segmenter_->setColorRange(lower, upper);
 }
 
+void VisionPipeline::updateColorRanges(const std::vector<HsvRange>& ranges) {
+    invalidateGate();
+    color_segmenter_->setColorRanges(ranges);
+}
+
+void VisionPipeline::updateSegmentationMode(SegmentationMode mode) {
+    invalidateGate();
+    color_segmenter_->setSegmentationMode(mode);
+}
+
+void VisionPipeline::updateMorphKernelSize(int size) {
+    invalidateGate();
+    color_segmenter_->setMorphKernelSize(size);
+}
+
+void VisionPipeline::updateMaskCleaning(MaskCleaning cleaning) {
+    invalidateGate();
+    color_segmenter_->setMaskCleaning(cleaning);
+}
+
+void VisionPipeline::updateComponentLimits(int min_component_area, int max_hole_area) {
+    invalidateGate();
+    color_segmenter_->setComponentLimits(min_component_area, max_hole_area);
+}
+
+void VisionPipeline::updateTiledSegmentation(bool enabled) {
+    color_segmenter_->setTiledExecution(enabled);
+}
+
+void VisionPipeline::updateThreadCount(int threads) {
+    color_segmenter_->setThreadCount(threads);
+}
+
+void VisionPipeline::updateCoarseToFine(int factor) {
+    invalidateGate();
+    coarse_factor_ = std::max(1, factor);
+}
+
+void VisionPipeline::updateChangeGating(bool enabled, int threshold) {
+    change_gating_ = enabled;
+    change_threshold_ = std::max(0, threshold);
+    invalidateGate();
+}
+
+void VisionPipeline::updateTracking(bool enabled, const cv::Point2f& direction, int max_missed) {
+    tracking_ = enabled;
+    piece_tracker_.setDirection(direction);
+    piece_tracker_.setMaxMissed(max_missed);
+    piece_tracker_.reset();
+    open_pieces_.clear();
+}
+
+void VisionPipeline::updateBeltStitching(bool enabled, int direction) {
+    invalidateGate();
+    belt_stitching_ = enabled;
+    belt_stitcher_.setDirection(direction);
+}
+
 void VisionPipeline::updateROI(const cv::Rect& roi) {
+    invalidateGate();
     roi_ = roi;
 }
 
+void VisionPipeline::updateCropToROI(bool enabled) {
+    invalidateGate();
+    crop_to_roi_ = enabled;
+}
+
+void VisionPipeline::updateROIPolygons(const std::vector<Polygon>& polygons) {
+    invalidateGate();
+    roi_polygons_.clear();
+    for (const auto& polygon : polygons) {
+        if (polygon.points.size() >= 3) {
+            roi_polygons_.push_back(polygon);
+        }
+    }
+    roi_spans_dirty_ = true;
+}
+
+void VisionPipeline::updateLanes(const std::vector<InspectionLane>& lanes) {
+    invalidateGate();
+    lanes_.clear();
+    for (const auto& lane : lanes) {
+        if (lane.region.points.size() >= 3) {
+            lanes_.push_back(lane);
+        } else {
+            std::cerr << "Ignoring lane '" << lane.name << "': region needs at least 3 points" << std::endl;
+        }
+    }
+    compileQualityPrograms();
+}
+
+int VisionPipeline::findLane(const cv::Point2f& center) const {
+    for (size_t l = 0; l < lanes_.size(); l++) {
+        if (cv::pointPolygonTest(lanes_[l].region.points, center, false) >= 0) {
+            return static_cast<int>(l);
+        }
+    }
+    return -1;
+}
+
+double VisionPipeline::segmentCoarseToFine(const cv::Mat& frame, const cv::Rect& work_area,
+                                           bool use_polygons) {
+    // Threshold an area-averaged copy of the work area; no cleaning, so
+    // pieces only a few coarse pixels across still show up
+    const cv::Size coarse_size(std::max(1, work_area.width / coarse_factor_),
+                               std::max(1, work_area.height / coarse_factor_));
+    cv::resize(frame(work_area), coarse_frame_, coarse_size, 0, 0, cv::INTER_AREA);
+    color_segmenter_->classify(coarse_frame_, coarse_mask_);
+    const std::vector<BlobStats>& candidates = coarse_labeler_.label(coarse_mask_);
+    
+    // Candidate boxes in frame coordinates, grown by one coarse pixel plus
+    // the cleaning reach so each piece is cleaned as in the full frame
+    const double scale_x = static_cast<double>(work_area.width) / coarse_size.width;
+    const double scale_y = static_cast<double>(work_area.height) / coarse_size.height;
+    const int margin = coarse_factor_ + color_segmenter_->getCleaningHalo();
+    fine_boxes_.clear();
+    for (const auto& candidate : candidates) {
+        const cv::Rect& b = candidate.bbox;
+        const int x0 = static_cast<int>(std::floor(b.x * scale_x)) - margin;
+        const int y0 = static_cast<int>(std::floor(b.y * scale_y)) - margin;
+        const int x1 = static_cast<int>(std::ceil((b.x + b.width) * scale_x)) + margin;
+        const int y1 = static_cast<int>(std::ceil((b.y + b.height) * scale_y)) + margin;
+        const cv::Rect box = (cv::Rect(x0, y0, x1 - x0, y1 - y0) + work_area.tl()) & work_area;
+        if (box.area() > 0) {
+            fine_boxes_.push_back(box);
+        }
+    }
+    
+    // Merge boxes that overlap or touch, so every piece is segmented once
+    // and runs from different boxes never touch
+    mergeTouchingBoxes(fine_boxes_);
+    
+    // Full-resolution segmentation of each box. Masks are only ever added,
+    // so each keeps its buffers for the boxes of later frames.
+    int64_t fine_area = 0;
+    if (fine_masks_.size() < fine_boxes_.size()) {
+        fine_masks_.resize(fine_boxes_.size());
+    }
+    for (size_t i = 0; i < fine_boxes_.size(); i++) {
+        const cv::Rect& box = fine_boxes_[i];
+        if (use_polygons) {
+            cropSpans(roi_spans_, box, fine_spans_);
+            color_segmenter_->segment(frame(box), fine_masks_[i], &fine_spans_, box.tl());
+        } else {
+            color_segmenter_->segment(frame(box), fine_masks_[i], nullptr, box.tl());
+        }
+        fine_area += box.area();
+    }
+    
+    // Stitch the boxes into one mask over the work area. Boxes sharing a
+    // row are disjoint, so in x order their runs stay sorted.
+    mask_runs_.reset(work_area);
+    for (int y = 0; y < work_area.height; y++) {
+        mask_runs_.row_offsets[y] = static_cast<int>(mask_runs_.runs.size());
+        for (size_t i = 0; i < fine_boxes_.size(); i++) {
+            const RleMask& box_mask = fine_masks_[i];
+            const int box_y = y + work_area.y - box_mask.bounds.y;
+            if (box_y < 0 || box_y >= box_mask.bounds.height) continue;
+            const int dx = box_mask.bounds.x - work_area.x;
+            for (int r = box_mask.rowBegin(box_y); r < box_mask.rowEnd(box_y); r++) {
+                const cv::Vec2i& run = box_mask.runs[r];
+                mask_runs_.runs.push_back(cv::Vec2i(run[0] + dx, run[1] + dx));
+            }
+        }
+    }
+    mask_runs_.row_offsets[work_area.height] = static_cast<int>(mask_runs_.runs.size());
+    
+    return static_cast<double>(fine_area) / work_area.area();
+}
+
+const cv::Mat& VisionPipeline::getSegmentedMask() const {
+    // Expanded from the runs only when asked for (e.g. the GUI overlay)
+    if (segmented_mask_stale_) {
+        segmented_mask_.create(mask_frame_size_, CV_8UC1);
+        segmented_mask_.setTo(0);
+        const cv::Rect visible = mask_runs_.bounds & cv::Rect(cv::Point(), mask_frame_size_);
+        if (visible == mask_runs_.bounds && visible.area() > 0) {
+            cv::Mat mask_view = segmented_mask_(mask_runs_.bounds);
+            decodeMask(mask_runs_, mask_view);
+        } else if (visible.area() > 0) {
+            // Stitched pieces partly past the frame edge
+            RleMask clipped = mask_runs_;
+            clipMask(clipped, visible);
+            cv::Mat mask_view = segmented_mask_(visible);
+            decodeMask(clipped, mask_view);
+        }
+        segmented_mask_stale_ = false;
+    }
+    return segmented_mask_;
+}
+
 void VisionPipeline::updateDetectionRules(const DetectionRules& rules) {
+    invalidateGate();
     rule_engine_->setRules(rules);
 }
 
 void VisionPipeline::updateQualityThresholds(const QualityThresholds& thresholds) {
+    invalidateGate();
     quality_thresholds_ = thresholds;
+    compileQualityPrograms();
+}
+
+void VisionPipeline::compileQualityPrograms() {
+    quality_programs_.resize(lanes_.size() + 1);
+    compileThresholds(quality_thresholds_, quality_programs_[0]);
+    for (size_t l = 0; l < lanes_.size(); l++) {
+        compileThresholds(lanes_[l].thresholds, quality_programs_[l + 1]);
+    }
 }
 
 VisionPipeline::PerformanceStats VisionPipeline::getPerformanceStats() const {
     PerformanceStats stats;
     stats.frame_count = frame_times_.size();
+    stats.simd_path = simdLevelName(simdKernels().level);
+    stats.thread_count = color_segmenter_->getThreadCount();
+    stats.last_band_ms = last_band_times_ms_;
     
     if (frame_times_.empty()) {
         stats.avg_total_ms = 0.0;
@@ -449,6 +1249,7 @@ void VisionPipeline::resetPerformanceStats() {
     frame_times_.clear();
     segmentation_times_.clear();
     contour_times_.clear();
+    last_band_times_ms_.clear();
 }
 
 } // namespace country_style
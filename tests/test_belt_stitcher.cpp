@@ -0,0 +1,170 @@
+// Belt stitching must count every piece that passes through the area
+// exactly once. A synthetic belt is moved under the camera at fractional
+// speeds in both directions; one strip on it is longer than the mosaic may
+// grow and must never be counted, nor the pieces it shares rows with when
+// it is cut off.
+#include "vision_pipeline.h"
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace country_style;
+
+namespace {
+
+const int kWidth = 640;
+const int kHeight = 480;
+const int kBeltLength = 9000;
+
+// Strip in the first lane, five area heights long; the mosaic is cut when
+// it holds four
+const int kStripFirst = 1500;
+const int kStripLast = kStripFirst + 5 * kHeight - 1;
+const int kStripCut = kStripFirst + 4 * kHeight;
+
+// Pieces are placed by belt row in the order rows come into view
+struct Piece {
+    int cx;
+    int ce;
+    int rx;
+    int re;
+};
+
+std::vector<Piece> makePieces() {
+    std::vector<Piece> pieces;
+    unsigned seed = 5;
+    for (int row = 60; row < kBeltLength - 400; row += 160) {
+        for (int lane = 0; lane < 3; lane++) {
+            seed = seed * 1103515245u + 12345u;
+            if ((seed >> 16) % 3 == 0) continue;
+            Piece p;
+            p.cx = 110 + lane * 210 + (seed >> 8) % 30;
+            p.ce = row + 55 + (seed >> 12) % 40;
+            p.rx = 25 + (seed >> 4) % 30;
+            p.re = 25 + (seed >> 20) % 30;
+            
+            // Keep clear of the strip, and of the rows where it is cut off
+            const int first = p.ce - p.re;
+            const int last = p.ce + p.re;
+            if (lane == 0 && last >= kStripFirst - 60 && first <= kStripLast + 60) continue;
+            if (last >= kStripCut - 300 && first <= kStripCut + 300) continue;
+            pieces.push_back(p);
+        }
+    }
+    return pieces;
+}
+
+// Belt image for a direction: belt row e comes into view e rows after the
+// first one
+cv::Mat makeBelt(const std::vector<Piece>& pieces, int direction) {
+    cv::Mat belt(kBeltLength, kWidth, CV_8UC3);
+    auto row = [&](int e) {
+        return belt.ptr<uint8_t>(direction > 0 ? kBeltLength - 1 - e : e);
+    };
+    
+    for (int e = 0; e < kBeltLength; e++) {
+        const uint8_t gray = static_cast<uint8_t>(
+            60 + 25 * std::sin(e * 0.37) + 15 * std::sin(e * 0.091) + (e * 7919) % 20);
+        uint8_t* p = row(e);
+        for (int x = 0; x < kWidth * 3; x++) p[x] = gray;
+    }
+    
+    auto paint = [](uint8_t* p) {
+        p[0] = 40;
+        p[1] = 200;
+        p[2] = 220;
+    };
+    for (const Piece& piece : pieces) {
+        for (int e = piece.ce - piece.re; e <= piece.ce + piece.re; e++) {
+            for (int x = piece.cx - piece.rx; x <= piece.cx + piece.rx; x++) {
+                const double dx = double(x - piece.cx) / piece.rx;
+                const double de = double(e - piece.ce) / piece.re;
+                if (dx * dx + de * de <= 1.0) paint(row(e) + x * 3);
+            }
+        }
+    }
+    for (int e = kStripFirst; e <= kStripLast; e++) {
+        for (int x = 110; x < 130; x++) paint(row(e) + x * 3);
+    }
+    return belt;
+}
+
+// Runs the belt through the pipeline at speed rows per frame; returns the
+// number of failed checks
+int countBelt(const char* config, const std::vector<Piece>& pieces, double speed,
+              int direction) {
+    VisionPipeline pipeline;
+    pipeline.initialize(config);
+    pipeline.updateROI(cv::Rect(0, 0, kWidth, kHeight));
+    DetectionRules rules{};
+    rules.min_area = 200;
+    rules.max_area = 1e9;
+    rules.max_circularity = 10.0;
+    rules.max_aspect_ratio = 100.0;
+    pipeline.updateDetectionRules(rules);
+    pipeline.updateBeltStitching(true, direction);
+    
+    const cv::Mat belt = makeBelt(pieces, direction);
+    std::vector<int> seen(pieces.size(), 0);
+    int counted = 0;
+    int unmatched = 0;
+    DetectionResult result;
+    const int frames = static_cast<int>((kBeltLength - kHeight) / speed);
+    for (int t = 0; t < frames; t++) {
+        const int offset = static_cast<int>(std::lround(t * speed));
+        const int base = direction > 0 ? kBeltLength - kHeight - offset : offset;
+        pipeline.processFrame(belt.rowRange(base, base + kHeight), result);
+        
+        counted += result.dough_count;
+        for (const DetectionMeasurement& m : result.measurements) {
+            const double e = direction > 0 ? offset + kHeight - 1 - m.center.y
+                                            : offset + m.center.y;
+            size_t match = pieces.size();
+            for (size_t i = 0; i < pieces.size(); i++) {
+                if (std::abs(m.center.x - pieces[i].cx) < 3 && std::abs(e - pieces[i].ce) < 3) {
+                    match = i;
+                }
+            }
+            if (match == pieces.size()) {
+                unmatched++;
+            } else {
+                seen[match]++;
+            }
+        }
+    }
+    
+    int failures = 0;
+    for (size_t i = 0; i < pieces.size(); i++) {
+        if (seen[i] != 1) {
+            std::printf("FAIL: speed %.2f, direction %+d: piece at row %d counted %d times\n",
+                        speed, direction, pieces[i].ce, seen[i]);
+            failures++;
+        }
+    }
+    if (unmatched != 0) {
+        std::printf("FAIL: speed %.2f, direction %+d: %d detections match no piece\n", speed,
+                    direction, unmatched);
+        failures++;
+    }
+    std::printf("speed %.2f, direction %+d: %d of %zu pieces counted in %d frames\n", speed,
+                direction, counted, pieces.size(), frames);
+    if (counted != static_cast<int>(pieces.size())) failures++;
+    return failures;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s <config.json>\n", argv[0]);
+        return 1;
+    }
+    const std::vector<Piece> pieces = makePieces();
+    
+    int failures = 0;
+    failures += countBelt(argv[1], pieces, 13.37, 1);
+    failures += countBelt(argv[1], pieces, 13.37, -1);
+    failures += countBelt(argv[1], pieces, 5.5, 1);
+    failures += countBelt(argv[1], pieces, 41.9, -1);
+    return failures ? 1 : 0;
+}
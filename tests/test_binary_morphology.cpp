@@ -0,0 +1,159 @@
+// Mask cleaning must match cv::morphologyEx(MORPH_OPEN, 2) followed by
+// cv::morphologyEx(MORPH_CLOSE, 2) bit for bit: BinaryMorphology on dense
+// and run masks, and FastColorSegmentation::cleanMask including its
+// cv::morphologyEx fallback for kernels that do not decompose.
+#include "binary_morphology.h"
+#include "fast_color_segmentation.h"
+#include <cstdio>
+#include <functional>
+#include <random>
+
+using namespace country_style;
+
+namespace {
+
+int failures = 0;
+int checks = 0;
+
+// Speckle plus solid blobs, with pixels set along every edge
+cv::Mat makeMask(int width, int height, std::mt19937& rng) {
+    cv::Mat mask(height, width, CV_8UC1, cv::Scalar(0));
+    const int density = 1 + rng() % 60;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (static_cast<int>(rng() % 100) < density) mask.at<uint8_t>(y, x) = 255;
+        }
+    }
+    for (int b = 0; b < 1 + (width * height) / 400; b++) {
+        const int cx = rng() % width, cy = rng() % height;
+        const int rx = 1 + rng() % 12, ry = 1 + rng() % 12;
+        for (int y = std::max(0, cy - ry); y <= std::min(height - 1, cy + ry); y++) {
+            for (int x = std::max(0, cx - rx); x <= std::min(width - 1, cx + rx); x++) {
+                mask.at<uint8_t>(y, x) = 255;
+            }
+        }
+    }
+    for (int x = 0; x < width; x += 2) {
+        mask.at<uint8_t>(0, x) = 255;
+        mask.at<uint8_t>(height - 1, width - 1 - x) = 255;
+    }
+    for (int y = 0; y < height; y += 3) {
+        mask.at<uint8_t>(y, 0) = 255;
+        mask.at<uint8_t>(height - 1 - y, width - 1) = 255;
+    }
+    return mask;
+}
+
+cv::Mat reference(const cv::Mat& mask, const cv::Mat& kernel) {
+    cv::Mat expected;
+    cv::morphologyEx(mask, expected, cv::MORPH_OPEN, kernel, cv::Point(-1, -1), 2,
+                     cv::BORDER_CONSTANT);
+    cv::morphologyEx(expected, expected, cv::MORPH_CLOSE, kernel, cv::Point(-1, -1), 2,
+                     cv::BORDER_CONSTANT);
+    return expected;
+}
+
+void expectSame(const cv::Mat& expected, const cv::Mat& actual, const char* path,
+                const cv::Size& kernel, const cv::Size& mask) {
+    checks++;
+    for (int y = 0; y < expected.rows; y++) {
+        for (int x = 0; x < expected.cols; x++) {
+            if ((expected.at<uint8_t>(y, x) != 0) != (actual.at<uint8_t>(y, x) != 0)) {
+                std::printf("FAIL %s: kernel %dx%d, mask %dx%d, first difference at (%d, %d)\n",
+                            path, kernel.width, kernel.height, mask.width, mask.height, x, y);
+                failures++;
+                return;
+            }
+        }
+    }
+}
+
+cv::Mat throughRuns(const cv::Mat& mask, const std::function<void(RleMask&)>& clean) {
+    RleMask runs;
+    encodeMask(mask, runs, cv::Point(5, 7));
+    clean(runs);
+    cv::Mat dense(mask.size(), CV_8UC1);
+    decodeMask(runs, dense);
+    return dense;
+}
+
+} // namespace
+
+int main() {
+    std::mt19937 rng(11);
+    const int widths[] = {1, 5, 63, 64, 65, 127, 129, 203};
+    const int heights[] = {1, 4, 33, 70};
+    
+    // Square ellipses 1..31, then non-square ones
+    std::vector<cv::Size> kernels;
+    for (int size = 1; size <= 31; size++) kernels.push_back(cv::Size(size, size));
+    const cv::Size non_square[] = {{3, 7}, {7, 3}, {5, 11}, {15, 4}, {2, 9}, {31, 5}, {9, 1}, {1, 9}};
+    kernels.insert(kernels.end(), std::begin(non_square), std::end(non_square));
+    
+    int decomposed = 0;
+    for (const cv::Size& size : kernels) {
+        const cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, size);
+        BinaryMorphology morphology;
+        if (!morphology.setKernel(kernel)) continue;  // Covered by the fallback below
+        decomposed++;
+        
+        for (int width : widths) {
+            for (int height : heights) {
+                const cv::Mat mask = makeMask(width, height, rng);
+                const cv::Mat expected = reference(mask, kernel);
+                
+                cv::Mat dense = mask.clone();
+                morphology.openClose(dense, 2, 2);
+                expectSame(expected, dense, "dense", size, mask.size());
+                
+                const cv::Mat runs = throughRuns(mask, [&](RleMask& m) {
+                    morphology.openClose(m, 2, 2);
+                });
+                expectSame(expected, runs, "runs", size, mask.size());
+            }
+        }
+        
+        // An ROI view is cleaned as a standalone image
+        cv::Mat parent(90, 150, CV_8UC1, cv::Scalar(255));
+        cv::Mat view = parent(cv::Rect(9, 6, 131, 77));
+        makeMask(view.cols, view.rows, rng).copyTo(view);
+        const cv::Mat expected = reference(view.clone(), kernel);
+        morphology.openClose(view, 2, 2);
+        expectSame(expected, view, "ROI view", size, view.size());
+    }
+    
+    // cleanMask for every kernel size the segmenter accepts, including those
+    // that fall back to cv::morphologyEx on a dense copy
+    int fallbacks = 0;
+    for (int size : {1, 2, 3, 5, 9, 17, 31, 64, 65}) {
+        FastColorSegmentation segmenter;
+        segmenter.setMorphKernelSize(size);
+        const cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(size, size));
+        BinaryMorphology probe;
+        if (!probe.setKernel(kernel)) fallbacks++;
+        
+        for (int width : {1, 65, 203}) {
+            for (int height : {1, 70}) {
+                const cv::Mat mask = makeMask(width, height, rng);
+                const cv::Mat cleaned = throughRuns(mask, [&](RleMask& m) {
+                    segmenter.cleanMask(m);
+                });
+                expectSame(reference(mask, kernel), cleaned, "cleanMask", kernel.size(),
+                           mask.size());
+            }
+        }
+    }
+    
+    std::printf("%d kernels decomposed, %d cleanMask sizes fell back, %d checks\n",
+                decomposed, fallbacks, checks);
+    if (fallbacks == 0) {
+        std::printf("FAIL: no kernel exercised the cv::morphologyEx fallback\n");
+        failures++;
+    }
+    if (failures) {
+        std::printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("mask cleaning matches cv::morphologyEx\n");
+    return 0;
+}
@@ -0,0 +1,228 @@
+// Blob measurements from run-based labeling must match
+// cv::connectedComponentsWithStats (8-connected): pixel count, bounding box
+// and centroid of every blob. Limits saved with traced-contour measurements
+// must be converted when a recipe is loaded, once.
+#include "contour_detector.h"
+#include "recipe_manager.h"
+#include <nlohmann/json.hpp>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+using namespace country_style;
+
+namespace {
+
+int failures = 0;
+
+// Ellipses, some with holes, diagonal-only joints, speckle and pixels on
+// every edge
+cv::Mat makeMask(int width, int height, std::mt19937& rng) {
+    cv::Mat mask(height, width, CV_8UC1, cv::Scalar(0));
+    for (int b = 0; b < 1 + width * height / 1500; b++) {
+        const int cx = rng() % width, cy = rng() % height;
+        const int rx = 1 + rng() % 25, ry = 1 + rng() % 25;
+        const double hole = (rng() % 3 == 0) ? 0.4 : 0.0;
+        for (int y = std::max(0, cy - ry); y <= std::min(height - 1, cy + ry); y++) {
+            for (int x = std::max(0, cx - rx); x <= std::min(width - 1, cx + rx); x++) {
+                const double dx = double(x - cx) / rx;
+                const double dy = double(y - cy) / ry;
+                const double d = dx * dx + dy * dy;
+                if (d <= 1.0 && d >= hole * hole) mask.at<uint8_t>(y, x) = 255;
+            }
+        }
+    }
+    for (int i = 0; i < width * height / 50; i++) {
+        const int x = rng() % width, y = rng() % height;
+        mask.at<uint8_t>(y, x) = 255;
+        if (x + 1 < width && y + 1 < height) mask.at<uint8_t>(y + 1, x + 1) = 255;
+    }
+    for (int x = 0; x < width; x += 3) {
+        mask.at<uint8_t>(0, x) = 255;
+        mask.at<uint8_t>(height - 1, x) = 255;
+    }
+    for (int y = 0; y < height; y += 3) {
+        mask.at<uint8_t>(y, 0) = 255;
+        mask.at<uint8_t>(y, width - 1) = 255;
+    }
+    return mask;
+}
+
+void checkMask(const cv::Mat& mask) {
+    const cv::Point origin(13, 7);
+    RleMask runs;
+    encodeMask(mask, runs, origin);
+    BlobLabeler labeler;
+    const std::vector<BlobStats>& blobs = labeler.label(runs);
+    
+    cv::Mat labels, stats, centroids;
+    const int count = cv::connectedComponentsWithStats(mask, labels, stats, centroids, 8, CV_32S);
+    if (static_cast<int>(blobs.size()) != count - 1) {
+        std::printf("FAIL: %dx%d mask: %zu blobs, OpenCV finds %d\n", mask.cols, mask.rows,
+                    blobs.size(), count - 1);
+        failures++;
+        return;
+    }
+    
+    // Blobs by the OpenCV label under the start of each of their runs
+    std::vector<int> blob_label(blobs.size(), -1);
+    for (int y = 0; y < runs.bounds.height; y++) {
+        for (int i = runs.rowBegin(y); i < runs.rowEnd(y); i++) {
+            const int label = labels.at<int>(y, runs.runs[i][0]);
+            const int blob = labeler.runBlob(i);
+            if (blob_label[blob] != -1 && blob_label[blob] != label) {
+                std::printf("FAIL: %dx%d mask: blob %d spans OpenCV labels %d and %d\n",
+                            mask.cols, mask.rows, blob, blob_label[blob], label);
+                failures++;
+                return;
+            }
+            blob_label[blob] = label;
+        }
+    }
+    
+    for (size_t b = 0; b < blobs.size(); b++) {
+        const int label = blob_label[b];
+        const cv::Rect box(stats.at<int>(label, cv::CC_STAT_LEFT) + origin.x,
+                           stats.at<int>(label, cv::CC_STAT_TOP) + origin.y,
+                           stats.at<int>(label, cv::CC_STAT_WIDTH),
+                           stats.at<int>(label, cv::CC_STAT_HEIGHT));
+        const cv::Point2d centroid(centroids.at<double>(label, 0) + origin.x,
+                                   centroids.at<double>(label, 1) + origin.y);
+        const BlobStats& blob = blobs[b];
+        if (blob.area != stats.at<int>(label, cv::CC_STAT_AREA) || blob.bbox != box ||
+            std::abs(blob.centroid.x - centroid.x) > 1e-3 ||
+            std::abs(blob.centroid.y - centroid.y) > 1e-3) {
+            std::printf("FAIL: %dx%d mask, blob %zu: area %d bbox (%d,%d %dx%d) centroid "
+                        "(%.3f, %.3f); OpenCV: %d (%d,%d %dx%d) (%.3f, %.3f)\n",
+                        mask.cols, mask.rows, b, blob.area, blob.bbox.x, blob.bbox.y,
+                        blob.bbox.width, blob.bbox.height, blob.centroid.x, blob.centroid.y,
+                        stats.at<int>(label, cv::CC_STAT_AREA), box.x, box.y, box.width,
+                        box.height, centroid.x, centroid.y);
+            failures++;
+            return;
+        }
+    }
+    
+    // measureBlobs reports the same numbers for blobs of 100 pixels or more
+    ContourDetector detector;
+    std::vector<ContourFeatures> features;
+    detector.measureBlobs(runs, features);
+    size_t next = 0;
+    for (const BlobStats& blob : blobs) {
+        if (blob.area < 100) continue;
+        if (next >= features.size() || features[next].area != blob.area ||
+            features[next].bounding_box != blob.bbox || features[next].center != blob.centroid) {
+            std::printf("FAIL: %dx%d mask: measureBlobs feature %zu differs from its blob\n",
+                        mask.cols, mask.rows, next);
+            failures++;
+            return;
+        }
+        next++;
+    }
+    if (next != features.size()) {
+        std::printf("FAIL: %dx%d mask: %zu features for %zu blobs of 100 pixels or more\n",
+                    mask.cols, mask.rows, features.size(), next);
+        failures++;
+    }
+}
+
+// Converted contour-area limits of discs against their pixel counts
+void checkConversion() {
+    for (int radius = 6; radius <= 80; radius += 7) {
+        cv::Mat disc(2 * radius + 5, 2 * radius + 5, CV_8UC1, cv::Scalar(0));
+        for (int y = 0; y < disc.rows; y++) {
+            for (int x = 0; x < disc.cols; x++) {
+                const int dx = x - radius - 2, dy = y - radius - 2;
+                if (dx * dx + dy * dy <= radius * radius) disc.at<uint8_t>(y, x) = 255;
+            }
+        }
+        RleMask runs;
+        encodeMask(disc, runs);
+        BlobLabeler labeler;
+        const BlobStats blob = labeler.label(runs)[0];
+        ContourArena arena;
+        labeler.traceContour(0, arena);
+        const double contour_area = cv::contourArea(arena.view(0).toVector());
+        
+        double min_area = contour_area, max_area = contour_area;
+        const double circularity = 4.0 * CV_PI * contour_area / (blob.perimeter * blob.perimeter);
+        double min_circularity = circularity, max_circularity = circularity;
+        convertContourAreaLimits(min_area, max_area, min_circularity, max_circularity);
+        
+        const double pixel_circularity =
+            4.0 * CV_PI * blob.area / (blob.perimeter * blob.perimeter);
+        if (std::abs(min_area / blob.area - 1.0) > 0.01 ||
+            std::abs(min_circularity / pixel_circularity - 1.0) > 0.01) {
+            std::printf("FAIL: disc of radius %d: contour area %.1f converts to %.1f, "
+                        "%d pixels; circularity %.3f to %.3f, %.3f by pixels\n",
+                        radius, contour_area, min_area, blob.area, circularity,
+                        min_circularity, pixel_circularity);
+            failures++;
+        }
+    }
+}
+
+// A recipe saved before pixel counts is converted on load, and once saved
+// again is not converted a second time
+void checkRecipeMigration() {
+    const std::filesystem::path dir =
+        std::filesystem::temp_directory_path() / "country_style_test_recipes";
+    std::filesystem::remove_all(dir);
+    RecipeManager manager;
+    manager.initialize(dir.string());
+    
+    nlohmann::json legacy;
+    legacy["name"] = "legacy";
+    legacy["detection_rules"] = {{"min_area", 2000.0}, {"max_area", 8000.0},
+                                 {"min_circularity", 0.7}, {"max_circularity", 1.0}};
+    legacy["quality"] = {{"min_area", 2000.0}, {"max_area", 8000.0}};
+    std::ofstream((dir / "legacy.json").string()) << legacy.dump(2);
+    
+    Recipe recipe;
+    double expected_min = 2000.0, expected_max = 8000.0;
+    double expected_min_c = 0.7, expected_max_c = 1.0;
+    convertContourAreaLimits(expected_min, expected_max, expected_min_c, expected_max_c);
+    for (int load = 0; load < 2; load++) {
+        if (!manager.loadRecipe("legacy", recipe) ||
+            recipe.detection_rules.min_area != expected_min ||
+            recipe.detection_rules.max_area != expected_max ||
+            recipe.detection_rules.min_circularity != expected_min_c ||
+            recipe.detection_rules.max_circularity != expected_max_c ||
+            recipe.quality_thresholds.min_area != expected_min ||
+            recipe.quality_thresholds.max_area != expected_max) {
+            std::printf("FAIL: legacy recipe limits after load %d: area %.1f-%.1f, "
+                        "circularity %.3f-%.3f\n", load + 1, recipe.detection_rules.min_area,
+                        recipe.detection_rules.max_area, recipe.detection_rules.min_circularity,
+                        recipe.detection_rules.max_circularity);
+            failures++;
+            break;
+        }
+        manager.saveRecipe(recipe);
+    }
+    std::filesystem::remove_all(dir);
+}
+
+} // namespace
+
+int main() {
+    std::mt19937 rng(13);
+    for (int width : {1, 2, 63, 64, 65, 200, 640}) {
+        for (int height : {1, 2, 17, 150, 480}) {
+            checkMask(makeMask(width, height, rng));
+        }
+    }
+    checkMask(cv::Mat(37, 53, CV_8UC1, cv::Scalar(255)));
+    checkMask(cv::Mat(37, 53, CV_8UC1, cv::Scalar(0)));
+    
+    checkConversion();
+    checkRecipeMigration();
+    
+    if (failures) {
+        std::printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("blob measurements match cv::connectedComponentsWithStats\n");
+    return 0;
+}
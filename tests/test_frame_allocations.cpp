@@ -0,0 +1,202 @@
+// processFrame(frame, result) must not allocate once the result and the
+// pipeline have grown to the busiest frame. Replaces the global operator
+// new and installs a cv::Mat allocator, since Mat buffers come from
+// cv::fastMalloc, to count every allocation made while a frame is processed.
+// Belt stitching is exempt: cv::phaseCorrelate allocates on every call.
+#include "vision_pipeline.h"
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+using namespace country_style;
+
+namespace {
+
+std::atomic<bool> counting(false);
+std::atomic<long> allocations(0);
+
+void* countedAlloc(std::size_t size) {
+    if (counting) allocations++;
+    void* p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+// Counts cv::Mat buffers and hands them to OpenCV's own allocator
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usage) const override {
+        if (counting && !data) allocations++;
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usage);
+    }
+    
+    bool allocate(cv::UMatData* data, cv::AccessFlag flags,
+                  cv::UMatUsageFlags usage) const override {
+        return cv::Mat::getStdAllocator()->allocate(data, flags, usage);
+    }
+    
+    void deallocate(cv::UMatData* data) const override {
+        cv::Mat::getStdAllocator()->deallocate(data);
+    }
+};
+
+const int kWidth = 640;
+const int kHeight = 480;
+const int kBeltLength = 3000;
+const int kFrames = 200;
+const int kStep = 7;  // Belt rows per frame
+
+// Long belt of gray stripes with dough-colored ellipses in three columns,
+// some left out, so the piece count changes from frame to frame
+cv::Mat makeBelt() {
+    cv::Mat belt(kBeltLength, kWidth, CV_8UC3);
+    for (int y = 0; y < kBeltLength; y++) {
+        const uint8_t gray = static_cast<uint8_t>(60 + 25 * std::sin(y * 0.37) + (y * 7919) % 20);
+        for (int x = 0; x < kWidth; x++) {
+            uint8_t* p = belt.ptr<uint8_t>(y) + x * 3;
+            p[0] = p[1] = p[2] = gray;
+        }
+    }
+    
+    unsigned seed = 7;
+    for (int row = 60; row < kBeltLength - 100; row += 150) {
+        for (int column = 0; column < 3; column++) {
+            seed = seed * 1103515245u + 12345u;
+            if ((seed >> 16) % 4 == 0) continue;
+            const int cx = 110 + column * 210 + (seed >> 8) % 30;
+            const int cy = row + (seed >> 12) % 30;
+            const int rx = 15 + (seed >> 4) % 40;
+            const int ry = 15 + (seed >> 20) % 40;
+            for (int y = cy - ry; y <= cy + ry; y++) {
+                for (int x = cx - rx; x <= cx + rx; x++) {
+                    const double dx = double(x - cx) / rx;
+                    const double dy = double(y - cy) / ry;
+                    if (dx * dx + dy * dy <= 1.0) {
+                        uint8_t* p = belt.ptr<uint8_t>(y) + x * 3;
+                        p[0] = 40;
+                        p[1] = 200;
+                        p[2] = 220;
+                    }
+                }
+            }
+        }
+    }
+    return belt;
+}
+
+QualityThresholds lineThresholds() {
+    QualityThresholds q{};
+    q.enable_area_check = true;
+    q.min_area = 3000;
+    q.max_area = 6000;
+    q.enable_aspect_ratio_check = true;
+    q.min_aspect_ratio = 0.6;
+    q.max_aspect_ratio = 1.6;
+    q.enable_count_check = true;
+    q.min_count = 4;
+    q.max_count = 6;
+    q.fail_on_undersized = true;
+    q.fail_on_oversized = true;
+    q.fail_on_count_mismatch = true;
+    q.fail_on_shape_defects = true;
+    return q;
+}
+
+// Runs the belt through the pipeline three times: the first passes grow
+// every buffer, the last must not allocate. Every pass after the first
+// starts by jumping back to the head of the belt, which ends all tracks at
+// once. A step of 0 holds the belt still. Returns the allocations counted.
+long countSteadyStateAllocations(VisionPipeline& pipeline, const cv::Mat& belt,
+                                 int step = kStep) {
+    DetectionResult result;
+    cv::Mat frame(kHeight, kWidth, CV_8UC3);
+    long total = 0;
+    for (int pass = 0; pass < 3; pass++) {
+        for (int t = 0; t < kFrames; t++) {
+            const int offset = (t * step) % (kBeltLength - kHeight);
+            belt.rowRange(offset, offset + kHeight).copyTo(frame);
+            
+            counting = pass == 2;
+            const long before = allocations;
+            pipeline.processFrame(frame, result);
+            counting = false;
+            total += allocations - before;
+        }
+    }
+    return total;
+}
+
+} // namespace
+
+void* operator new(std::size_t size) { return countedAlloc(size); }
+void* operator new[](std::size_t size) { return countedAlloc(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <config.json>" << std::endl;
+        return 1;
+    }
+    static CountingMatAllocator mat_allocator;
+    cv::Mat::setDefaultAllocator(&mat_allocator);
+    
+    const cv::Mat belt = makeBelt();
+    int failures = 0;
+    auto report = [&](const char* name, long n) {
+        std::cout << name << ": " << n << " allocations in " << kFrames << " frames"
+                  << std::endl;
+        if (n != 0) failures++;
+    };
+    
+    // Shipped default configuration
+    {
+        VisionPipeline pipeline;
+        pipeline.initialize(argv[1]);
+        report("default config", countSteadyStateAllocations(pipeline, belt));
+    }
+    
+    // Change gating, on a still belt where frames are reused and on a moving
+    // one where they are segmented and cached
+    {
+        VisionPipeline pipeline;
+        pipeline.initialize(argv[1]);
+        pipeline.updateChangeGating(true, 4);
+        report("change gating, still", countSteadyStateAllocations(pipeline, belt, 0));
+        report("change gating, moving", countSteadyStateAllocations(pipeline, belt));
+    }
+    
+    // Piece tracking: pieces enter, are judged and leave every few frames
+    {
+        VisionPipeline pipeline;
+        pipeline.initialize(argv[1]);
+        pipeline.updateTracking(true, cv::Point2f(0, -1), 2);
+        report("piece tracking", countSteadyStateAllocations(pipeline, belt));
+    }
+    
+    // Two lanes with their own thresholds, so detections fail checks
+    {
+        VisionPipeline pipeline;
+        pipeline.initialize(argv[1]);
+        pipeline.updateQualityThresholds(lineThresholds());
+        
+        InspectionLane left;
+        left.name = "Left lane";
+        left.region.points = {{0, 0}, {320, 0}, {320, kHeight}, {0, kHeight}};
+        left.thresholds = lineThresholds();
+        InspectionLane right = left;
+        right.name = "Right lane";
+        right.region.points = {{320, 0}, {640, 0}, {640, kHeight}, {320, kHeight}};
+        right.thresholds.min_area = 2000;
+        pipeline.updateLanes({left, right});
+        
+        report("lanes config", countSteadyStateAllocations(pipeline, belt));
+    }
+    
+    return failures ? 1 : 0;
+}
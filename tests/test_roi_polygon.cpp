@@ -0,0 +1,74 @@
+// ROI rasterization checks: the spans must cover the union of the polygons
+#include "roi_polygon.h"
+#include <iostream>
+
+using namespace country_style;
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char* what) {
+    if (!condition) {
+        std::cerr << "FAIL: " << what << std::endl;
+        failures++;
+    }
+}
+
+Polygon square(float x, float y, float size) {
+    Polygon polygon;
+    polygon.points = {{x, y}, {x + size, y}, {x + size, y + size}, {x, y + size}};
+    polygon.is_good_sample = true;
+    return polygon;
+}
+
+// Is frame pixel (x, y) inside one of the spans?
+bool covered(const RoiSpans& spans, int x, int y) {
+    const int row = y - spans.bounds.y;
+    if (row < 0 || row >= spans.bounds.height) return false;
+    for (int s = spans.row_offsets[row]; s < spans.row_offsets[row + 1]; s++) {
+        if (x - spans.bounds.x >= spans.spans[s][0] && x - spans.bounds.x < spans.spans[s][1]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+int main() {
+    const cv::Size frame_size(200, 200);
+    RoiSpans spans;
+    
+    // Two overlapping squares: the shared part must stay covered
+    rasterizeRoiPolygons({square(20, 20, 60), square(50, 50, 60)}, frame_size, spans);
+    check(spans.bounds == cv::Rect(20, 20, 91, 91), "bounds of overlapping squares");
+    check(covered(spans, 30, 30), "first square covered");
+    check(covered(spans, 100, 100), "second square covered");
+    check(covered(spans, 65, 65), "overlap covered");
+    check(!covered(spans, 100, 30), "outside both squares not covered");
+    
+    // Each row of the overlap is one run across both squares
+    const int row = 65 - spans.bounds.y;
+    check(spans.row_offsets[row + 1] - spans.row_offsets[row] == 1, "overlap row is one span");
+    
+    // Same polygon twice covers the same pixels as once
+    RoiSpans once;
+    rasterizeRoiPolygons({square(20, 20, 60)}, frame_size, once);
+    rasterizeRoiPolygons({square(20, 20, 60), square(20, 20, 60)}, frame_size, spans);
+    check(spans.spans == once.spans && spans.row_offsets == once.row_offsets,
+          "duplicate polygon does not cancel out");
+    
+    // Polygons off the frame are clipped, degenerate ones ignored
+    Polygon line;
+    line.points = {{0, 0}, {10, 10}};
+    rasterizeRoiPolygons({square(150, 150, 100), line}, frame_size, spans);
+    check(spans.bounds == cv::Rect(150, 150, 50, 50), "clipped to frame");
+    
+    if (failures) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "roi polygon tests passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,178 @@
+// FastColorSegmentation::segment splits the frame into bands, one or more
+// per thread and, when tiled, more to fit L2, and cleans each band with halo
+// rows from its neighbours. The runs must be the same as classifying and
+// cleaning the whole frame in one piece, tiled or not, for any thread count,
+// frame height and kernel size, with both cleaning modes and with and
+// without polygon spans.
+#include "fast_color_segmentation.h"
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace country_style;
+
+namespace {
+
+int failures = 0;
+int checks = 0;
+int halo_over_band = 0;  // Checks whose bands were thinner than the halo
+
+// Dough-colored ellipses with pinholes on a gray belt, plus speckle
+cv::Mat makeFrame(int width, int height, std::mt19937& rng) {
+    cv::Mat frame(height, width, CV_8UC3, cv::Scalar(70, 70, 70));
+    auto paint = [&](int x, int y, bool dough) {
+        uint8_t* p = frame.ptr<uint8_t>(y) + x * 3;
+        p[0] = dough ? 40 : 70;
+        p[1] = dough ? 200 : 70;
+        p[2] = dough ? 220 : 70;
+    };
+    
+    for (int b = 0; b < 1 + width * height / 3000; b++) {
+        const int cx = rng() % width, cy = rng() % height;
+        const int rx = 2 + rng() % 30, ry = 2 + rng() % 30;
+        for (int y = std::max(0, cy - ry); y <= std::min(height - 1, cy + ry); y++) {
+            for (int x = std::max(0, cx - rx); x <= std::min(width - 1, cx + rx); x++) {
+                const double dx = double(x - cx) / rx;
+                const double dy = double(y - cy) / ry;
+                if (dx * dx + dy * dy <= 1.0) paint(x, y, rng() % 50 != 0);
+            }
+        }
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (rng() % 40 == 0) paint(x, y, true);
+        }
+    }
+    return frame;
+}
+
+// Concave polygon across the whole frame, so closing could bridge its notch
+void makeSpans(const cv::Size& size, RoiSpans& spans) {
+    const float w = static_cast<float>(size.width);
+    const float h = static_cast<float>(size.height);
+    Polygon polygon;
+    polygon.points = {{0.05f * w, 0.0f}, {0.95f * w, 0.1f * h}, {0.6f * w, 0.5f * h},
+                      {0.9f * w, h}, {0.1f * w, 0.9f * h}, {0.45f * w, 0.5f * h}};
+    rasterizeRoiPolygons({polygon}, size, spans);
+}
+
+bool sameRuns(const RleMask& a, const RleMask& b) {
+    return a.bounds == b.bounds && a.row_offsets == b.row_offsets && a.runs == b.runs;
+}
+
+// Rows in a band when the frame is split by size alone: one more row makes
+// a second band. 4096 when no frame that tall is split.
+int singleBandRows(FastColorSegmentation& segmenter, int width, std::mt19937& rng) {
+    segmenter.setThreadCount(1);
+    RleMask mask;
+    int low = 1, high = 4096;
+    while (low < high) {
+        const int rows = (low + high + 1) / 2;
+        segmenter.segment(makeFrame(width, rows, rng), mask);
+        if (segmenter.getLastBandCount() == 1) {
+            low = rows;
+        } else {
+            high = rows - 1;
+        }
+    }
+    return low;
+}
+
+void configure(FastColorSegmentation& segmenter, MaskCleaning cleaning, int kernel) {
+    segmenter.setMaskCleaning(cleaning);
+    segmenter.setMorphKernelSize(kernel);
+    segmenter.setComponentLimits(50, 200);
+}
+
+// Every thread count, tiled and untiled, against one whole-frame classify
+// and clean
+void checkFrame(const cv::Mat& frame, MaskCleaning cleaning, int kernel, bool use_spans) {
+    RoiSpans spans;
+    cv::Rect area(0, 0, frame.cols, frame.rows);
+    if (use_spans) {
+        makeSpans(frame.size(), spans);
+        if (spans.empty()) return;
+        area = spans.bounds;
+    }
+    const RoiSpans* span_ptr = use_spans ? &spans : nullptr;
+    
+    FastColorSegmentation reference;
+    configure(reference, cleaning, kernel);
+    RleMask expected;
+    reference.classify(frame(area), expected, span_ptr, area.tl());
+    reference.cleanMask(expected);
+    if (use_spans) {
+        RleMask clipped;
+        clearOutsideSpans(expected, spans, clipped);
+        std::swap(expected, clipped);
+    }
+    
+    FastColorSegmentation segmenter;
+    configure(segmenter, cleaning, kernel);
+    for (bool tiled : {true, false}) {
+        segmenter.setTiledExecution(tiled);
+        for (int threads : {1, 2, 4, 8}) {
+            segmenter.setThreadCount(threads);
+            RleMask mask;
+            segmenter.segment(frame(area), mask, span_ptr, area.tl());
+            checks++;
+            
+            // Bands after the first are at most this tall
+            const int bands = segmenter.getLastBandCount();
+            if (bands > 1 && (area.height - 1) / (bands - 1) < segmenter.getCleaningHalo()) {
+                halo_over_band++;
+            }
+            
+            if (!sameRuns(expected, mask)) {
+                std::printf("FAIL: %s, kernel %d, %dx%d frame%s, %s, %d threads, %d bands\n",
+                            cleaning == MaskCleaning::Morphology ? "morphology" : "components",
+                            kernel, frame.cols, frame.rows, use_spans ? " with spans" : "",
+                            tiled ? "tiled" : "untiled", threads, bands);
+                failures++;
+            }
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    std::mt19937 rng(3);
+    
+    for (int width : {640, 203}) {
+        for (int kernel = 1; kernel <= 9; kernel++) {
+            FastColorSegmentation probe;
+            configure(probe, MaskCleaning::Morphology, kernel);
+            const int band = singleBandRows(probe, width, rng);
+            
+            // Thread splits of a short frame, a 4K-tall frame and the band
+            // edges of the size split, when the kernel allows one
+            std::vector<int> heights = {1, 100, 2160};
+            if (band < 4096) {
+                heights.push_back(band - 1);
+                heights.push_back(band + 1);
+            }
+            for (int height : heights) {
+                const cv::Mat frame = makeFrame(width, height, rng);
+                for (bool use_spans : {false, true}) {
+                    checkFrame(frame, MaskCleaning::Morphology, kernel, use_spans);
+                    if (kernel == 1) {
+                        checkFrame(frame, MaskCleaning::Components, kernel, use_spans);
+                    }
+                }
+            }
+        }
+    }
+    
+    if (halo_over_band == 0) {
+        std::printf("FAIL: no check had bands thinner than the cleaning halo\n");
+        failures++;
+    }
+    if (failures) {
+        std::printf("%d of %d checks failed\n", failures, checks);
+        return 1;
+    }
+    std::printf("band segmentation matches whole-frame cleaning in %d checks, "
+                "%d with bands thinner than the halo\n", checks, halo_over_band);
+    return 0;
+}